@@ -0,0 +1,132 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Audio.h"
+#include "ByteStream.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+Chip8::AudioFrame Chip8::audio_frame_of(const Cpu& cpu)
+{
+    AudioFrame frame;
+    frame.active = cpu.is_sound_active();
+    frame.pitch = cpu.get_pitch();
+    const uint8_t* pattern = cpu.get_audio_pattern();
+    std::copy(pattern, pattern + AUDIO_PATTERN_SIZE, frame.pattern);
+    return frame;
+}
+
+Chip8::AudioSynth::AudioSynth(unsigned int sample_rate)
+    : m_sample_rate(sample_rate)
+{
+}
+
+unsigned int Chip8::AudioSynth::get_samples_per_frame() const
+{
+    return m_sample_rate / FRAMES_PER_SECOND;
+}
+
+void Chip8::AudioSynth::render(const AudioFrame& frame, int16_t* samples, size_t count)
+{
+    if (!frame.active) {
+        std::fill(samples, samples + count, 0);
+        m_phase = 0;
+        return;
+    }
+    if (m_step == 0 || frame.pitch != m_pitch) {
+        m_pitch = frame.pitch;
+        m_step = 4000.0 * std::exp2((m_pitch - 64) / 48.0) / m_sample_rate;
+    }
+    const double pattern_bits = AUDIO_PATTERN_SIZE * 8;
+    for (size_t i = 0; i < count; i++) {
+        unsigned int bit = static_cast<unsigned int>(m_phase);
+        bool high = frame.pattern[bit >> 3u] & (0x80u >> (bit & 7u));
+        samples[i] = high ? AMPLITUDE : -AMPLITUDE;
+        m_phase += m_step;
+        if (m_phase >= pattern_bits) {
+            m_phase -= pattern_bits;
+        }
+    }
+}
+
+bool Chip8::AudioStream::push(const AudioFrame& frame)
+{
+    return m_queue.push(frame);
+}
+
+void Chip8::AudioStream::fill(int16_t* samples, size_t count)
+{
+    while (count > 0) {
+        if (m_left_in_frame == 0) {
+            if (!m_queue.pop(m_frame)) {
+                m_frame.active = false;
+                m_synth.render(m_frame, samples, count);
+                return;
+            }
+            m_left_in_frame = m_synth.get_samples_per_frame();
+        }
+        size_t chunk = std::min<size_t>(count, m_left_in_frame);
+        m_synth.render(m_frame, samples, chunk);
+        samples += chunk;
+        count -= chunk;
+        m_left_in_frame -= chunk;
+    }
+}
+
+void Chip8::AudioStream::fill_callback(void* stream, int16_t* samples, int count)
+{
+    static_cast<AudioStream*>(stream)->fill(samples, count);
+}
+
+/**
+ * Canonical 44 byte RIFF header followed by the samples, little endian
+ * like everything Writer produces.
+ */
+bool Chip8::write_wav(const std::string& file, const std::vector<int16_t>& samples, unsigned int sample_rate)
+{
+    const uint16_t channels = 1;
+    const uint16_t bits = 16;
+    uint32_t data_size = samples.size() * sizeof(int16_t);
+    std::vector<uint8_t> blob;
+    blob.reserve(44 + data_size);
+    Writer writer(blob);
+    writer.put_bytes(reinterpret_cast<const uint8_t*>("RIFF"), 4);
+    writer.put<uint32_t>(36 + data_size);
+    writer.put_bytes(reinterpret_cast<const uint8_t*>("WAVEfmt "), 8);
+    writer.put<uint32_t>(16);
+    writer.put<uint16_t>(1);
+    writer.put(channels);
+    writer.put<uint32_t>(sample_rate);
+    writer.put<uint32_t>(sample_rate * channels * bits / 8);
+    writer.put<uint16_t>(channels * bits / 8);
+    writer.put(bits);
+    writer.put_bytes(reinterpret_cast<const uint8_t*>("data"), 4);
+    writer.put(data_size);
+    for (int16_t sample : samples) {
+        writer.put(static_cast<uint16_t>(sample));
+    }
+    std::ofstream out(file, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(blob.data()), blob.size());
+    return out.good();
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "Cpu.h"
+#include <SpscRing.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Chip8 {
+    // 48 kHz divides evenly into frames, 800 samples each
+    const unsigned int AUDIO_SAMPLE_RATE = 48000;
+
+    /**
+     * What the sound hardware did during one frame. The plain beeper is
+     * the default pattern, a square wave, played at the default pitch.
+     */
+    struct AudioFrame {
+        bool active;
+        uint8_t pitch;
+        uint8_t pattern[AUDIO_PATTERN_SIZE];
+    };
+
+    // the sound state of the frame cpu has just finished
+    AudioFrame audio_frame_of(const Cpu& cpu);
+
+    /**
+     * Turns frames into 16 bit mono samples. The pattern is played one bit
+     * per step at 4000 * 2^((pitch - 64) / 48) steps per second, the
+     * position in the pattern carries over from one frame to the next so
+     * a held tone doesn't click at every frame boundary.
+     */
+    class AudioSynth final {
+    public:
+        explicit AudioSynth(unsigned int sample_rate = AUDIO_SAMPLE_RATE);
+        void render(const AudioFrame& frame, int16_t* samples, size_t count);
+        unsigned int get_samples_per_frame() const;
+
+    private:
+        static constexpr int16_t AMPLITUDE = 8000;
+
+        unsigned int m_sample_rate;
+        uint8_t m_pitch = 0;
+        double m_step = 0;
+        // position in the pattern, in bits
+        double m_phase = 0;
+    };
+
+    /**
+     * Hands frames from the emulation thread to the audio callback through
+     * a lock-free ring. The emulation side never waits, a frame is dropped
+     * when the device is that far behind. The callback plays silence when
+     * it runs out of frames.
+     */
+    class AudioStream final {
+    public:
+        bool push(const AudioFrame& frame);
+        void fill(int16_t* samples, size_t count);
+        // signature of the device callback, stream is the AudioStream
+        static void fill_callback(void* stream, int16_t* samples, int count);
+
+        // bounds the latency to this many frames
+        static constexpr size_t QUEUE_FRAMES = 8;
+
+    private:
+        Common::SpscRing<AudioFrame, QUEUE_FRAMES> m_queue;
+        // only touched by the callback
+        AudioSynth m_synth;
+        AudioFrame m_frame {};
+        unsigned int m_left_in_frame = 0;
+    };
+
+    // 16 bit mono PCM
+    bool write_wav(const std::string& file, const std::vector<int16_t>& samples, unsigned int sample_rate = AUDIO_SAMPLE_RATE);
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Chip8 {
+    /**
+     * Little endian serialization helpers shared by the binary file formats.
+     * Reader never reads past the end, it returns zeros instead and ok()
+     * turns false.
+     */
+    class Writer final {
+    public:
+        explicit Writer(std::vector<uint8_t>& out)
+            : m_out(out)
+        {
+        }
+
+        template<typename T>
+        void put(T value)
+        {
+            for (size_t i = 0; i < sizeof(T); i++) {
+                m_out.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8)));
+            }
+        }
+
+        void put_bytes(const uint8_t* data, size_t size)
+        {
+            m_out.insert(m_out.end(), data, data + size);
+        }
+
+    private:
+        std::vector<uint8_t>& m_out;
+    };
+
+    class Reader final {
+    public:
+        explicit Reader(const std::vector<uint8_t>& in)
+            : m_in(in)
+        {
+        }
+
+        template<typename T>
+        T get()
+        {
+            uint64_t value = 0;
+            for (size_t i = 0; i < sizeof(T); i++) {
+                value |= static_cast<uint64_t>(next()) << (i * 8);
+            }
+            return static_cast<T>(value);
+        }
+
+        void get_bytes(uint8_t* data, size_t size)
+        {
+            for (size_t i = 0; i < size; i++) {
+                data[i] = next();
+            }
+        }
+
+        bool ok() const
+        {
+            return !m_overrun;
+        }
+
+    private:
+        uint8_t next()
+        {
+            if (m_position >= m_in.size()) {
+                m_overrun = true;
+                return 0;
+            }
+            return m_in[m_position++];
+        }
+
+        const std::vector<uint8_t>& m_in;
+        size_t m_position = 0;
+        bool m_overrun = false;
+    };
+}
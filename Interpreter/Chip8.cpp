@@ -23,48 +23,205 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Chip8.h"
 #include <Entity.h>
+#include <FramePacer.h>
 #include <Graphics.h>
+#include <Print.h>
 #include <Types.h>
+#include <algorithm>
 #include <chrono>
-#include <fstream>
 #include <iostream>
+#include <thread>
 
 Chip8::Chip8Application::Chip8Application(Graphics::Types::Size size)
-    : Graphics::Window(size, Graphics::Types::Size(64, 32), "Chip8")
+    : Graphics::Window(size, Graphics::Types::Size(DisplayBuffer::get_width(), DisplayBuffer::get_height()), "Chip8")
+    , m_frames(std::vector<uint32_t>(DisplayBuffer::get_width() * DisplayBuffer::get_height()))
+    , m_audio_device(AUDIO_SAMPLE_RATE, &AudioStream::fill_callback, &m_audio)
 {
-    m_memory_manager = std::make_shared<MemoryManager>();
-    m_display = std::make_shared<DisplayBuffer>();
-    m_cpu = std::make_unique<Cpu>(m_memory_manager, m_display);
+    set_seed(std::chrono::system_clock::now().time_since_epoch().count());
 }
 
+static constexpr auto FRAME_DURATION = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(1.0 / Chip8::FRAMES_PER_SECOND));
+// how long the render loop sleeps when there is no new frame to present
+static constexpr auto RENDER_IDLE = std::chrono::milliseconds(1);
+
+/**
+ * The machine runs on its own thread, paced to 60 frames per second. This
+ * thread keeps the window: it polls input and presents whatever frame was
+ * finished last, so waiting for vsync never holds up the emulation.
+ */
 void Chip8::Chip8Application::launch(const std::string& file)
 {
-    int video_pitch = sizeof(m_display->get_display_data()[0]) * m_display->get_width();
-    load_program(file);
-    bool quit = false;
-    auto last_cycle = std::chrono::high_resolution_clock::now();
-    while (!quit) {
-        quit = process_input(m_cpu->get_keypad());
-        auto now = std::chrono::high_resolution_clock::now();
-        float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(now - last_cycle).count();
-        if (dt > 1) {
-            m_cpu->execute();
-            update_texture(m_display->get_display_data(), video_pitch);
+    if (!m_machine.load_program(file)) {
+        Common::err("Failed to open ", file);
+        return;
+    }
+    Cpu& cpu = m_machine.get_cpu();
+    if (m_replaying) {
+        cpu.set_quirks(m_input_log.get_quirks());
+        cpu.set_seed(m_input_log.get_seed());
+        cpu.set_cycles_per_frame(m_input_log.get_cycles_per_frame());
+    } else {
+        m_input_log.set_quirks(cpu.get_quirks());
+        m_input_log.set_cycles_per_frame(cpu.get_cycles_per_frame());
+    }
+    // after the quirks, a plugin generated for other ones is refused
+    if (!m_recompiled_file.empty() && !cpu.load_recompiled(m_recompiled_file)) {
+        Common::err("Running ", file, " on the interpreter");
+    }
+    publish_frame();
+    m_audio_device.set_paused(false);
+    std::thread emulation(&Chip8Application::run_emulation, this);
+    uint16_t keys = 0;
+    while (!m_quit.load(std::memory_order_relaxed)) {
+        if (process_input(keys)) {
+            m_quit.store(true, std::memory_order_relaxed);
+        }
+        m_input_keys.store(keys, std::memory_order_relaxed);
+        if (m_frames.update()) {
+            present_frame();
+        } else {
+            std::this_thread::sleep_for(RENDER_IDLE);
+        }
+    }
+    emulation.join();
+    m_audio_device.set_paused(true);
+    auto stats = m_machine.get_memory().get_decode_cache_stats();
+    Common::msg("decode cache: ", stats.hits, " hits, ", stats.misses, " misses, ", stats.invalidations, " invalidations");
+#ifdef CHIP8_PROFILER
+    cpu.get_profiler().write_report(std::cout);
+#endif
+    if (!m_record_file.empty() && !m_input_log.save(m_record_file)) {
+        Common::err("Failed to save input to ", m_record_file);
+    }
+}
+
+/**
+ * Runs one frame per iteration until either thread asks to quit. A frame
+ * is only published once run_until stopped at its end, so the window never
+ * gets to see a display in the middle of an instruction.
+ */
+void Chip8::Chip8Application::run_emulation()
+{
+    Cpu& cpu = m_machine.get_cpu();
+    DisplayBuffer& display = m_machine.get_display();
+    InputReplay replay(m_input_log);
+    uint64_t published_generation = display.get_generation();
+    Common::FramePacer pacer(FRAME_DURATION);
+    while (!m_quit.load(std::memory_order_relaxed)) {
+        if (m_replaying) {
+            RunResult result = replay.run_until(cpu, static_cast<unsigned int>(StopReason::FrameBoundary), cpu.get_cycles_per_frame());
+            if (static_cast<unsigned int>(result.reason) & FAULT_EVENTS) {
+                Common::err("Stopped: ", to_string(result.reason));
+                m_quit.store(true, std::memory_order_relaxed);
+            }
+            m_audio.push(audio_frame_of(cpu));
+        } else if (m_rewinding.load(std::memory_order_relaxed)) {
+            cpu.set_keypad_mask(m_input_keys.load(std::memory_order_relaxed));
+            rewind_frame();
+        } else {
+            cpu.set_keypad_mask(m_input_keys.load(std::memory_order_relaxed));
+            m_input_log.record(cpu.get_cycle_count(), cpu.get_keypad_mask());
+            RunResult result = cpu.run_until(static_cast<unsigned int>(StopReason::FrameBoundary), cpu.get_cycles_per_frame());
+            if (static_cast<unsigned int>(result.reason) & FAULT_EVENTS) {
+                Common::err("Stopped: ", to_string(result.reason));
+                m_quit.store(true, std::memory_order_relaxed);
+            }
+            m_audio.push(audio_frame_of(cpu));
+            m_machine.save_state(*m_rewind_state);
+            m_rewind.push(*m_rewind_state);
+        }
+        if (display.get_generation() != published_generation) {
+            published_generation = display.get_generation();
+            publish_frame();
         }
+        pacer.wait_for_next_frame();
     }
 }
 
-void Chip8::Chip8Application::load_program(const std::string& source_file)
+void Chip8::Chip8Application::handle_key(SDL_Keycode key, bool pressed)
 {
-    std::ifstream infile(source_file, std::ios::binary | std::ios::ate);
-    if (infile.is_open()) {
-        std::streampos size = infile.tellg();
-        char* buffer = new char[size];
-
-        infile.seekg(0, std::ios::beg);
-        infile.read(buffer, size);
-        infile.close();
-        m_memory_manager->place_program(buffer, size);
-        delete[] buffer;
+    if (key == SDLK_BACKSPACE) {
+        m_rewinding = pressed;
     }
 }
+
+/**
+ * Steps one frame back in the history, the keypad is left as the player
+ * currently holds it instead of what it was back then.
+ */
+void Chip8::Chip8Application::rewind_frame()
+{
+    if (!m_rewind.pop(*m_rewind_state)) {
+        return;
+    }
+    m_rewind_state->cpu.keypad = m_machine.get_cpu().get_keypad_mask();
+    m_machine.load_state(*m_rewind_state);
+    m_input_log.truncate(m_machine.get_cpu().get_cycle_count());
+}
+
+void Chip8::Chip8Application::publish_frame()
+{
+    m_machine.get_display().expand_to_rgba(m_frames.back().data());
+    m_frames.publish();
+}
+
+void Chip8::Chip8Application::present_frame()
+{
+    int video_pitch = sizeof(uint32_t) * DisplayBuffer::get_width();
+    update_texture(m_frames.front().data(), video_pitch);
+}
+
+void Chip8::Chip8Application::set_cpu_core(CpuCore core)
+{
+    m_machine.get_cpu().set_core(core);
+}
+
+void Chip8::Chip8Application::set_cycles_per_frame(unsigned int cycles)
+{
+    m_machine.get_cpu().set_cycles_per_frame(cycles);
+}
+
+void Chip8::Chip8Application::set_fusion(bool enabled)
+{
+    m_machine.get_cpu().set_fusion(enabled);
+}
+
+void Chip8::Chip8Application::set_quirks(QuirkProfile profile)
+{
+    m_machine.get_cpu().set_quirks(profile);
+}
+
+void Chip8::Chip8Application::set_seed(Common::u64 seed)
+{
+    m_machine.get_cpu().set_seed(seed);
+    m_input_log.set_seed(seed);
+}
+
+/**
+ * Keypad changes are recorded at the frame they were sampled on and
+ * written to file when the window is closed.
+ */
+void Chip8::Chip8Application::record_input(const std::string& file)
+{
+    m_record_file = file;
+}
+
+/**
+ * The plugin is loaded once the program is in memory, it has to have
+ * been generated from the same ROM.
+ */
+void Chip8::Chip8Application::use_recompiled(const std::string& file)
+{
+    m_recompiled_file = file;
+}
+
+/**
+ * Plays back a recorded session instead of reading the keyboard, using
+ * the seed, speed and quirks stored in the recording.
+ */
+bool Chip8::Chip8Application::replay_input(const std::string& file)
+{
+    m_replaying = m_input_log.load(file);
+    return m_replaying;
+}
@@ -22,24 +22,61 @@
 // OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
-#include "Cpu.h"
-#include "DisplayBuffer.h"
+#include "Audio.h"
+#include "InputLog.h"
+#include "Machine.h"
+#include "Rewind.h"
+#include <AudioDevice.h>
+#include <TripleBuffer.h>
 #include <Window.h>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace Chip8 {
     class Chip8Application final : public Graphics::Window {
     public:
         explicit Chip8Application(Graphics::Types::Size size);
         void launch(const std::string& file);
+        void set_cpu_core(CpuCore core);
+        void set_cycles_per_frame(unsigned int cycles);
+        void set_fusion(bool enabled);
+        void set_quirks(QuirkProfile profile);
+        void set_seed(Common::u64 seed);
+        void record_input(const std::string& file);
+        bool replay_input(const std::string& file);
+        void use_recompiled(const std::string& file);
+
+    protected:
+        void handle_key(SDL_Keycode key, bool pressed) override;
 
     private:
-        void load_program(const std::string& source_file);
+        void run_emulation();
+        void publish_frame();
+        void present_frame();
+        void rewind_frame();
 
     private:
-        std::shared_ptr<MemoryManager> m_memory_manager = nullptr;
-        std::shared_ptr<DisplayBuffer> m_display = nullptr;
-        std::unique_ptr<Cpu> m_cpu = nullptr;
+        // owned by the emulation thread while launch runs
+        Machine m_machine;
+        // finished frames, written by the emulation thread and presented
+        // by the thread that owns the window
+        Common::TripleBuffer<std::vector<uint32_t>> m_frames;
+        // the keypad as the window thread last saw it, one bit per key,
+        // latched into the Cpu at the start of every frame
+        std::atomic<uint16_t> m_input_keys { 0 };
+        std::atomic<bool> m_quit { false };
+        // one state per frame, rewound while backspace is held
+        RewindBuffer m_rewind;
+        std::unique_ptr<MachineState> m_rewind_state = std::make_unique<MachineState>();
+        std::atomic<bool> m_rewinding { false };
+        InputLog m_input_log;
+        std::string m_record_file;
+        bool m_replaying = false;
+        std::string m_recompiled_file;
+        // filled once per emulated frame, drained by the device callback
+        AudioStream m_audio;
+        Graphics::AudioDevice m_audio_device;
     };
 }
\ No newline at end of file
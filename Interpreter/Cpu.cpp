@@ -22,52 +22,54 @@
 // OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Cpu.h"
+#include <Print.h>
 #include <Types.h>
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
 #include <iostream>
-#include <chrono>
 #include <utility>
 
+#if defined(__GNUC__) || defined(__clang__)
+#    define HAS_COMPUTED_GOTO
+#endif
+
 using namespace Common;
 
 Chip8::Cpu::Cpu(std::shared_ptr<MemoryManager> memory_manager, std::shared_ptr<DisplayBuffer> display)
     : m_memory_manager(std::move(memory_manager))
     , m_display(std::move(display))
-, m_random_generator(std::chrono::system_clock::now().time_since_epoch().count())
 {
-    m_random_byte = std::uniform_int_distribution<uint8_t>(0, 255U);
+    set_core(default_core());
+    std::fill(std::begin(table), std::end(table), &Cpu::opcode_none);
+    std::fill(std::begin(table0), std::end(table0), &Cpu::opcode_none);
+    std::fill(std::begin(table5), std::end(table5), &Cpu::opcode_none);
+    std::fill(std::begin(table8), std::end(table8), &Cpu::opcode_none);
+    std::fill(std::begin(tableE), std::end(tableE), &Cpu::opcode_none);
+    std::fill(std::begin(tableF), std::end(tableF), &Cpu::opcode_none);
 
     table[0x0] = &Cpu::table_0;
     table[0x1] = &Cpu::opcode_1nnn;
     table[0x2] = &Cpu::opcode_2nnn;
-    table[0x3] = &Cpu::opcode_3xkk;
-    table[0x4] = &Cpu::opcode_4xkk;
-    table[0x5] = &Cpu::opcode_5xy0;
+    table[0x5] = &Cpu::table_5;
     table[0x6] = &Cpu::opcode_6xkk;
     table[0x7] = &Cpu::opcode_7xkk;
     table[0x8] = &Cpu::table_8;
-    table[0x9] = &Cpu::opcode_9xy0;
     table[0xA] = &Cpu::opcode_Annn;
-    table[0xB] = &Cpu::opcode_Bnnn;
     table[0xC] = &Cpu::opcode_Cxkk;
-    table[0xD] = &Cpu::opcode_Dxyn;
     table[0xE] = &Cpu::table_e;
     table[0xF] = &Cpu::table_f;
 
-    table0[0x0] = &Cpu::opcode_00E0;
-    table0[0xE] = &Cpu::opcode_00EE;
+    // only the low nibble tells 00E0 and 00EE apart, like in decode
+    for (unsigned int kk = 0; kk <= 0xFF; kk += 0x10) {
+        table0[kk] = &Cpu::opcode_00E0;
+        table0[kk | 0xE] = &Cpu::opcode_00EE;
+    }
 
     table8[0x0] = &Cpu::opcode_8xy0;
-    table8[0x1] = &Cpu::opcode_8xy1;
-    table8[0x2] = &Cpu::opcode_8xy2;
-    table8[0x3] = &Cpu::opcode_8xy3;
     table8[0x4] = &Cpu::opcode_8xy4;
     table8[0x5] = &Cpu::opcode_8xy5;
-    table8[0x6] = &Cpu::opcode_8xy6;
     table8[0x7] = &Cpu::opcode_8xy7;
-    table8[0xE] = &Cpu::opcode_8xyE;
-
-    tableE[0x1] = &Cpu::opcode_ExA1;
-    tableE[0xE] = &Cpu::opcode_Ex9E;
 
     tableF[0x07] = &Cpu::opcode_Fx07;
     tableF[0x0A] = &Cpu::opcode_Fx0A;
@@ -76,8 +78,59 @@ Chip8::Cpu::Cpu(std::shared_ptr<MemoryManager> memory_manager, std::shared_ptr<D
     tableF[0x1E] = &Cpu::opcode_Fx1E;
     tableF[0x29] = &Cpu::opcode_Fx29;
     tableF[0x33] = &Cpu::opcode_Fx33;
-    tableF[0x55] = &Cpu::opcode_Fx55;
-    tableF[0x65] = &Cpu::opcode_Fx65;
+    build_tables<ModernQuirks>();
+
+    // a plain square wave until a program loads its own pattern
+    std::fill(std::begin(m_audio_pattern), std::end(m_audio_pattern), 0xF0);
+}
+
+/**
+ * Points the table core at the handlers of one profile, everything
+ * that behaves the same in all of them is set up by the constructor.
+ */
+template<typename Profile>
+void Chip8::Cpu::build_tables()
+{
+    table[0x3] = &Cpu::opcode_3xkk<Profile>;
+    table[0x4] = &Cpu::opcode_4xkk<Profile>;
+    table[0x9] = &Cpu::opcode_9xy0<Profile>;
+    table[0xB] = &Cpu::opcode_Bnnn<Profile>;
+    table[0xD] = &Cpu::opcode_Dxyn<Profile>;
+
+    // the extended instructions check the profile themselves and fall
+    // back to what the original tables did when it doesn't have them
+    for (unsigned int n = 0; n <= 0xF; ++n) {
+        table0[0xC0 | n] = &Cpu::opcode_00Cn<Profile>;
+        table0[0xD0 | n] = &Cpu::opcode_00Dn<Profile>;
+    }
+    table0[0xFB] = &Cpu::opcode_00FB<Profile>;
+    table0[0xFC] = &Cpu::opcode_00FC<Profile>;
+    table0[0xFE] = &Cpu::opcode_00FE<Profile>;
+    table0[0xFF] = &Cpu::opcode_00FF<Profile>;
+
+    // 5xy2 and 5xy3 are XO-CHIP, everything else still matches 5xy0
+    for (unsigned int n = 0; n <= 0xF; ++n) {
+        table5[n] = &Cpu::opcode_5xy0<Profile>;
+    }
+    table5[0x2] = &Cpu::opcode_5xy2<Profile>;
+    table5[0x3] = &Cpu::opcode_5xy3<Profile>;
+
+    table8[0x1] = &Cpu::opcode_8xy1<Profile>;
+    table8[0x2] = &Cpu::opcode_8xy2<Profile>;
+    table8[0x3] = &Cpu::opcode_8xy3<Profile>;
+    table8[0x6] = &Cpu::opcode_8xy6<Profile>;
+    table8[0xE] = &Cpu::opcode_8xyE<Profile>;
+
+    tableE[0x1] = &Cpu::opcode_ExA1<Profile>;
+    tableE[0xE] = &Cpu::opcode_Ex9E<Profile>;
+
+    tableF[0x00] = &Cpu::opcode_F000<Profile>;
+    tableF[0x01] = &Cpu::opcode_Fn01<Profile>;
+    tableF[0x02] = &Cpu::opcode_F002<Profile>;
+    tableF[0x30] = &Cpu::opcode_Fx30<Profile>;
+    tableF[0x3A] = &Cpu::opcode_Fx3A<Profile>;
+    tableF[0x55] = &Cpu::opcode_Fx55<Profile>;
+    tableF[0x65] = &Cpu::opcode_Fx65<Profile>;
 }
 
 void Chip8::Cpu::dump()
@@ -114,143 +167,1105 @@ void Chip8::Cpu::core_dump()
               << std::flush;
 }
 
+Chip8::CpuCore Chip8::Cpu::default_core()
+{
+#if defined(CPU_CORE_TABLE)
+    return CpuCore::Table;
+#elif defined(CPU_CORE_SWITCH)
+    return CpuCore::Switch;
+#elif defined(CPU_CORE_JIT)
+    return CpuCore::Jit;
+#else
+    return CpuCore::Threaded;
+#endif
+}
+
+const char* Chip8::to_string(CpuCore core)
+{
+    switch (core) {
+    case CpuCore::Table:
+        return "table";
+    case CpuCore::Switch:
+        return "switch";
+    case CpuCore::Threaded:
+        return "threaded";
+    case CpuCore::Jit:
+        return "jit";
+    }
+    return "unknown";
+}
+
+bool Chip8::parse_core(const std::string& name, CpuCore& core)
+{
+    for (CpuCore candidate : { CpuCore::Table, CpuCore::Switch, CpuCore::Threaded, CpuCore::Jit }) {
+        if (name == to_string(candidate)) {
+            core = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Chip8::Cpu::set_core(CpuCore core)
+{
+    m_core = core == CpuCore::Jit && !Jit::is_supported() ? CpuCore::Threaded : core;
+}
+
+Chip8::JitStats Chip8::Cpu::get_jit_stats() const
+{
+    return m_jit ? m_jit->get_stats() : JitStats {};
+}
+
+/**
+ * Loads a program translated by chip8_recompile, the program it was
+ * generated from has to be in memory already.
+ */
+bool Chip8::Cpu::load_recompiled(const std::string& file)
+{
+    m_jit.reset();
+    m_recompiled = std::make_unique<RecompiledProgram>(*this, *m_memory_manager);
+    if (!m_recompiled->load(file)) {
+        m_recompiled.reset();
+        return false;
+    }
+    return true;
+}
+
+bool Chip8::Cpu::is_recompiled_active() const
+{
+    return m_recompiled && m_recompiled->is_active();
+}
+
+Chip8::CpuCore Chip8::Cpu::get_core() const
+{
+    return m_core;
+}
+
+Chip8::Instruction Chip8::Cpu::fetch()
+{
+    Instruction instruction = m_memory_manager->get_instruction_at(m_program_counter);
+    m_program_counter += 2;
+    return instruction;
+}
+
+void Chip8::Cpu::set_cycles_per_frame(unsigned int cycles)
+{
+    m_cycles_per_frame = cycles > 0 ? cycles : 1;
+    m_frame_cycle = 0;
+}
+
+unsigned int Chip8::Cpu::get_cycles_per_frame() const
+{
+    return m_cycles_per_frame;
+}
+
+Chip8::u64 Chip8::Cpu::get_cycle_count() const
+{
+    return m_cycle_count;
+}
+
+Chip8::u64 Chip8::Cpu::get_frame_count() const
+{
+    return m_frame_count;
+}
+
+uint8_t Chip8::Cpu::get_delay_timer() const
+{
+    return m_delay_timer;
+}
+
+uint8_t Chip8::Cpu::get_sound_timer() const
+{
+    return m_sound_timer;
+}
+
+/**
+ * The AUDIO_PATTERN_SIZE bytes F002 loaded, played one bit at a time at
+ * 4000 * 2 ^ ((pitch - 64) / 48) bits per second while the sound timer
+ * runs.
+ */
+const uint8_t* Chip8::Cpu::get_audio_pattern() const
+{
+    return m_audio_pattern;
+}
+
+uint8_t Chip8::Cpu::get_pitch() const
+{
+    return m_pitch;
+}
+
+/**
+ * The timer counts down at the end of the frame, so a timer of n sounds
+ * for n frames.
+ */
+bool Chip8::Cpu::is_sound_active() const
+{
+    return m_sound_active;
+}
+
 void Chip8::Cpu::execute()
+{
+    run_cycles(1);
+}
+
+Chip8::RunResult Chip8::Cpu::run_cycles(u64 budget)
+{
+    return run_until(0, budget);
+}
+
+/**
+ * Runs until budget instructions have been executed, a fault happened
+ * or one of the events in the mask occurred. Instructions are executed
+ * in blocks that never cross a frame boundary.
+ */
+Chip8::RunResult Chip8::Cpu::run_until(unsigned int events, u64 budget)
+{
+    unsigned int requested = events | FAULT_EVENTS;
+    m_stop_mask = requested | (m_idle_skipping ? IDLE_EVENTS : 0);
+    u64 executed = 0;
+    while (executed < budget) {
+        u64 block = std::min<u64>(budget - executed, m_cycles_per_frame - m_frame_cycle);
+        m_events = 0;
+        u64 done = block - execute_block(block);
+        unsigned int raised = m_events & requested;
+        if (!raised && (m_events & IDLE_EVENTS)) {
+            done += fast_forward_idle_loop(block - done);
+            raised = m_events & requested;
+        }
+        executed += done;
+        m_cycle_count += done;
+        m_frame_cycle += done;
+        if (raised) {
+            return { reason_for(raised), executed };
+        }
+        if (m_frame_cycle == m_cycles_per_frame) {
+            end_frame();
+            if (requested & static_cast<unsigned int>(StopReason::FrameBoundary)) {
+                return { StopReason::FrameBoundary, executed };
+            }
+        }
+    }
+    return { StopReason::BudgetExhausted, executed };
+}
+
+/**
+ * Called on every backward jump. When the same jump is reached again with
+ * the registers and I unchanged and nothing else was touched in between,
+ * every further pass through the loop is going to do exactly the same
+ * until a timer ticks or a key changes.
+ */
+void Chip8::Cpu::check_idle_loop(uint16_t jump_address)
+{
+    if (m_idle_check.pure && m_idle_check.jump_address == jump_address
+        && m_idle_check.address_register == m_address_register
+        && std::equal(std::begin(m_registers), std::end(m_registers), m_idle_check.registers)) {
+        m_events |= EVENT_IDLE_LOOP;
+    }
+    m_idle_check.jump_address = jump_address;
+    m_idle_check.address_register = m_address_register;
+    std::copy(std::begin(m_registers), std::end(m_registers), m_idle_check.registers);
+    m_idle_check.pure = true;
+}
+
+/**
+ * Runs one more pass of a detected idle loop to learn its length and then
+ * skips as many whole passes as fit into remaining. The pass only counts
+ * when it ends on the idle event again, i.e. it was just as pure as the
+ * one that was detected. A detection straddling a timer tick compares
+ * against the old timer value, so one more pass is measured before giving
+ * up. Whatever is left over is executed normally, so the state afterwards
+ * is exactly what running every instruction would have produced. The
+ * events of the measured passes are left in m_events. Returns the cycles
+ * consumed.
+ */
+Chip8::u64 Chip8::Cpu::fast_forward_idle_loop(u64 remaining)
+{
+    uint16_t start = m_program_counter;
+    uint16_t jump_address = m_idle_check.jump_address;
+    unsigned int raised = 0;
+    u64 consumed = 0;
+    for (unsigned int pass = 0; pass < 2; pass++) {
+        unsigned int last = 0;
+        u64 length = 0;
+        bool closed = false;
+        bool stopped = false;
+        while (consumed + length < remaining && !closed && !stopped) {
+            uint16_t address = m_program_counter;
+            m_events = 0;
+            stopped = execute_block(1) != 0;
+            last = m_events;
+            raised |= last;
+            if (stopped) {
+                break;
+            }
+            ++length;
+            stopped = last & m_stop_mask & ~IDLE_EVENTS;
+            closed = address == jump_address && m_program_counter == start;
+        }
+        consumed += length;
+        if (!closed || stopped) {
+            break;
+        }
+        if (last & IDLE_EVENTS) {
+            u64 skipped = (remaining - consumed) / length * length;
+            m_idle_cycles += skipped;
+            m_events = raised;
+            return consumed + skipped;
+        }
+    }
+    m_events = raised;
+    return consumed;
+}
+
+void Chip8::Cpu::set_idle_skipping(bool enabled)
+{
+    m_idle_skipping = enabled;
+}
+
+/**
+ * Fused pairs are on by default, turning them off makes the Switch and
+ * Threaded cores dispatch every instruction on its own again.
+ */
+void Chip8::Cpu::set_fusion(bool enabled)
+{
+    m_memory_manager->set_fusion(enabled);
+}
+
+Chip8::u64 Chip8::Cpu::get_idle_cycles() const
+{
+    return m_idle_cycles;
+}
+
+/**
+ * Selects the handlers for profile. Translated code bakes the profile
+ * in, so the Jit starts over and a recompiled program generated for
+ * another profile is dropped.
+ */
+void Chip8::Cpu::set_quirks(QuirkProfile profile)
+{
+    m_quirks = profile;
+    switch (profile) {
+    case QuirkProfile::Modern:
+        build_tables<ModernQuirks>();
+        break;
+    case QuirkProfile::Chip8:
+        build_tables<Chip8Quirks>();
+        break;
+    case QuirkProfile::SuperChip:
+        build_tables<SuperChipQuirks>();
+        break;
+    case QuirkProfile::XoChip:
+        build_tables<XoChipQuirks>();
+        // F000 NNNN can point I anywhere in the 64 KB
+        m_memory_manager->require_size(MemoryManager::MEMORY_SIZE);
+        break;
+    }
+    m_jit.reset();
+    if (m_recompiled && m_recompiled->get_quirks() != profile) {
+        Common::err("recompiled program was generated for other quirks, not using it\n");
+        m_recompiled.reset();
+    }
+}
+
+Chip8::QuirkProfile Chip8::Cpu::get_quirks() const
+{
+    return m_quirks;
+}
+
+const char* Chip8::to_string(StopReason reason)
+{
+    switch (reason) {
+    case StopReason::BudgetExhausted:
+        return "budget_exhausted";
+    case StopReason::FrameBoundary:
+        return "frame_boundary";
+    case StopReason::WaitingForKey:
+        return "waiting_for_key";
+    case StopReason::DisplayChanged:
+        return "display_changed";
+    case StopReason::InvalidOpcode:
+        return "invalid_opcode";
+    case StopReason::StackOverflow:
+        return "stack_overflow";
+    case StopReason::StackUnderflow:
+        return "stack_underflow";
+    }
+    return "unknown";
+}
+
+Chip8::StopReason Chip8::Cpu::reason_for(unsigned int events)
+{
+    for (StopReason reason : { StopReason::StackOverflow, StopReason::StackUnderflow, StopReason::InvalidOpcode,
+             StopReason::WaitingForKey, StopReason::DisplayChanged }) {
+        if (events & static_cast<unsigned int>(reason)) {
+            return reason;
+        }
+    }
+    return StopReason::BudgetExhausted;
+}
+
+void Chip8::Cpu::end_frame()
+{
+    m_frame_cycle = 0;
+    ++m_frame_count;
+    if (m_delay_timer > 0) {
+        --m_delay_timer;
+    }
+    m_sound_active = m_sound_timer > 0;
+    if (m_sound_active) {
+        --m_sound_timer;
+    }
+}
+
+/**
+ * Executes up to cycles instructions with the selected core and returns
+ * how many of them were left when an event in m_stop_mask stopped it.
+ */
+Chip8::u64 Chip8::Cpu::execute_block(u64 cycles)
+{
+#ifdef CHIP8_PROFILER
+    return execute_profiled(cycles);
+#else
+    return dispatch_block(cycles);
+#endif
+}
+
+#ifdef CHIP8_PROFILER
+/**
+ * Runs the selected core one instruction at a time so every instruction
+ * can be attributed to its address and operation. The time includes the
+ * dispatch of the core, which is what differs between them.
+ */
+Chip8::u64 Chip8::Cpu::execute_profiled(u64 cycles)
+{
+    while (cycles > 0 && !(m_events & m_stop_mask)) {
+        uint16_t address = m_program_counter;
+        Operation operation = m_memory_manager->get_instruction_at(address).operation;
+        u64 start = Profiler::now();
+        dispatch_block(1);
+        m_profiler.record(address, operation, Profiler::now() - start);
+        --cycles;
+    }
+    return cycles;
+}
+
+Chip8::Profiler& Chip8::Cpu::get_profiler()
+{
+    return m_profiler;
+}
+#endif
+
+Chip8::u64 Chip8::Cpu::dispatch_block(u64 cycles)
+{
+    if (m_recompiled && m_recompiled->is_active()) {
+        return m_recompiled->run(cycles);
+    }
+    switch (m_quirks) {
+    case QuirkProfile::Chip8:
+        return run_core<Chip8Quirks>(cycles);
+    case QuirkProfile::SuperChip:
+        return run_core<SuperChipQuirks>(cycles);
+    case QuirkProfile::XoChip:
+        return run_core<XoChipQuirks>(cycles);
+    case QuirkProfile::Modern:
+        break;
+    }
+    return run_core<ModernQuirks>(cycles);
+}
+
+template<typename Profile>
+Chip8::u64 Chip8::Cpu::run_core(u64 cycles)
+{
+    switch (m_core) {
+    case CpuCore::Table:
+        while (cycles > 0 && !(m_events & m_stop_mask)) {
+            execute_table();
+            --cycles;
+        }
+        break;
+    case CpuCore::Switch:
+        while (cycles > 0 && !(m_events & m_stop_mask)) {
+            Instruction instruction = fetch();
+            if (instruction.fusion != Fusion::None && cycles > 1) {
+                cycles -= execute_fused<Profile>(instruction);
+            } else {
+                execute_instruction<Profile>(instruction);
+                --cycles;
+            }
+        }
+        break;
+    case CpuCore::Threaded:
+        cycles = execute_threaded<Profile>(cycles);
+        break;
+    case CpuCore::Jit:
+        if (!m_jit) {
+            m_jit = std::make_unique<Jit>(*this, *m_memory_manager);
+        }
+        cycles = m_jit->run(cycles);
+        break;
+    }
+    return cycles;
+}
+
+void Chip8::Cpu::execute_table()
 {
     m_opcode = m_memory_manager->get_at_position(m_program_counter);
     m_program_counter += 2;
-    ((*this).*(table[(m_opcode & 0xF000u) >> 12u]))();
+    ((*this).*(table[(m_opcode & 0xF000u) >> 12u]))(decode_fields(m_opcode));
+}
+
+void Chip8::Cpu::execute_switch()
+{
+    execute_instruction(fetch());
 }
 
-void Chip8::Cpu::opcode_none()
+/**
+ * For the paths that run single instructions outside of the cores,
+ * picks the handlers of the selected profile.
+ */
+void Chip8::Cpu::execute_instruction(const Instruction& instruction)
 {
+    switch (m_quirks) {
+    case QuirkProfile::Modern:
+        execute_instruction<ModernQuirks>(instruction);
+        break;
+    case QuirkProfile::Chip8:
+        execute_instruction<Chip8Quirks>(instruction);
+        break;
+    case QuirkProfile::SuperChip:
+        execute_instruction<SuperChipQuirks>(instruction);
+        break;
+    case QuirkProfile::XoChip:
+        execute_instruction<XoChipQuirks>(instruction);
+        break;
+    }
+}
+
+template<typename Profile>
+void Chip8::Cpu::execute_instruction(const Instruction& instruction)
+{
+    switch (instruction.operation) {
+    case Operation::Op00E0:
+        opcode_00E0(instruction);
+        break;
+    case Operation::Op00EE:
+        opcode_00EE(instruction);
+        break;
+    case Operation::Op00Cn:
+        opcode_00Cn<Profile>(instruction);
+        break;
+    case Operation::Op00Dn:
+        opcode_00Dn<Profile>(instruction);
+        break;
+    case Operation::Op00FB:
+        opcode_00FB<Profile>(instruction);
+        break;
+    case Operation::Op00FC:
+        opcode_00FC<Profile>(instruction);
+        break;
+    case Operation::Op00FE:
+        opcode_00FE<Profile>(instruction);
+        break;
+    case Operation::Op00FF:
+        opcode_00FF<Profile>(instruction);
+        break;
+    case Operation::Op1nnn:
+        opcode_1nnn(instruction);
+        break;
+    case Operation::Op2nnn:
+        opcode_2nnn(instruction);
+        break;
+    case Operation::Op3xkk:
+        opcode_3xkk<Profile>(instruction);
+        break;
+    case Operation::Op4xkk:
+        opcode_4xkk<Profile>(instruction);
+        break;
+    case Operation::Op5xy0:
+        opcode_5xy0<Profile>(instruction);
+        break;
+    case Operation::Op5xy2:
+        opcode_5xy2<Profile>(instruction);
+        break;
+    case Operation::Op5xy3:
+        opcode_5xy3<Profile>(instruction);
+        break;
+    case Operation::Op6xkk:
+        opcode_6xkk(instruction);
+        break;
+    case Operation::Op7xkk:
+        opcode_7xkk(instruction);
+        break;
+    case Operation::Op8xy0:
+        opcode_8xy0(instruction);
+        break;
+    case Operation::Op8xy1:
+        opcode_8xy1<Profile>(instruction);
+        break;
+    case Operation::Op8xy2:
+        opcode_8xy2<Profile>(instruction);
+        break;
+    case Operation::Op8xy3:
+        opcode_8xy3<Profile>(instruction);
+        break;
+    case Operation::Op8xy4:
+        opcode_8xy4(instruction);
+        break;
+    case Operation::Op8xy5:
+        opcode_8xy5(instruction);
+        break;
+    case Operation::Op8xy6:
+        opcode_8xy6<Profile>(instruction);
+        break;
+    case Operation::Op8xy7:
+        opcode_8xy7(instruction);
+        break;
+    case Operation::Op8xyE:
+        opcode_8xyE<Profile>(instruction);
+        break;
+    case Operation::Op9xy0:
+        opcode_9xy0<Profile>(instruction);
+        break;
+    case Operation::OpAnnn:
+        opcode_Annn(instruction);
+        break;
+    case Operation::OpBnnn:
+        opcode_Bnnn<Profile>(instruction);
+        break;
+    case Operation::OpCxkk:
+        opcode_Cxkk(instruction);
+        break;
+    case Operation::OpDxyn:
+        opcode_Dxyn<Profile>(instruction);
+        break;
+    case Operation::OpEx9E:
+        opcode_Ex9E<Profile>(instruction);
+        break;
+    case Operation::OpExA1:
+        opcode_ExA1<Profile>(instruction);
+        break;
+    case Operation::OpF000:
+        opcode_F000<Profile>(instruction);
+        break;
+    case Operation::OpFn01:
+        opcode_Fn01<Profile>(instruction);
+        break;
+    case Operation::OpF002:
+        opcode_F002<Profile>(instruction);
+        break;
+    case Operation::OpFx07:
+        opcode_Fx07(instruction);
+        break;
+    case Operation::OpFx0A:
+        opcode_Fx0A(instruction);
+        break;
+    case Operation::OpFx15:
+        opcode_Fx15(instruction);
+        break;
+    case Operation::OpFx18:
+        opcode_Fx18(instruction);
+        break;
+    case Operation::OpFx1E:
+        opcode_Fx1E(instruction);
+        break;
+    case Operation::OpFx29:
+        opcode_Fx29(instruction);
+        break;
+    case Operation::OpFx30:
+        opcode_Fx30<Profile>(instruction);
+        break;
+    case Operation::OpFx33:
+        opcode_Fx33(instruction);
+        break;
+    case Operation::OpFx3A:
+        opcode_Fx3A<Profile>(instruction);
+        break;
+    case Operation::OpFx55:
+        opcode_Fx55<Profile>(instruction);
+        break;
+    case Operation::OpFx65:
+        opcode_Fx65<Profile>(instruction);
+        break;
+    case Operation::None:
+    case Operation::Count:
+        opcode_none(instruction);
+        break;
+    }
 }
 
-void Chip8::Cpu::table_0()
+/**
+ * Runs a fused pair whose first instruction was just fetched and returns
+ * how many instructions that was. Only called with room for both in the
+ * budget, so a frame boundary can't fall between them.
+ */
+template<typename Profile>
+unsigned int Chip8::Cpu::execute_fused(const Instruction& instruction)
 {
-    ((*this).*(table0[m_opcode & 0x000Fu]))();
+    switch (instruction.fusion) {
+    case Fusion::OpAnnnDxyn:
+        return fused_AnnnDxyn<Profile>(instruction);
+    case Fusion::OpFx29Dxyn:
+        return fused_Fx29Dxyn<Profile>(instruction);
+    case Fusion::Op6xkk6xkk:
+        return fused_6xkk6xkk(instruction);
+    case Fusion::Op6xkk8xy2:
+        return fused_6xkk8xy2<Profile>(instruction);
+    case Fusion::Op6xkkExA1:
+        return fused_6xkkExA1<Profile>(instruction);
+    case Fusion::Op3xkk1nnn:
+        return fused_3xkk1nnn<Profile>(instruction);
+    case Fusion::Op4xkk1nnn:
+        return fused_4xkk1nnn<Profile>(instruction);
+    case Fusion::Op7xkk3xkk:
+        return fused_7xkk3xkk<Profile>(instruction);
+    case Fusion::OpFx073xkk:
+        return fused_Fx073xkk<Profile>(instruction);
+    case Fusion::None:
+    case Fusion::Count:
+        break;
+    }
+    execute_instruction<Profile>(instruction);
+    return 1;
+}
+
+/**
+ * Direct threaded core: every handler jumps straight to the handler
+ * of the next instruction instead of returning to a central loop.
+ * Fused pairs get their own handlers when both fit into the budget.
+ */
+template<typename Profile>
+Chip8::u64 Chip8::Cpu::execute_threaded(u64 cycles)
+{
+#ifdef HAS_COMPUTED_GOTO
+    static void* const labels[static_cast<int>(Operation::Count) + 1] = {
+        &&op_none, &&op_00E0, &&op_00EE, &&op_00Cn, &&op_00Dn, &&op_00FB,
+        &&op_00FC, &&op_00FE, &&op_00FF, &&op_1nnn, &&op_2nnn, &&op_3xkk,
+        &&op_4xkk, &&op_5xy0, &&op_5xy2, &&op_5xy3, &&op_6xkk, &&op_7xkk,
+        &&op_8xy0, &&op_8xy1, &&op_8xy2, &&op_8xy3, &&op_8xy4, &&op_8xy5,
+        &&op_8xy6, &&op_8xy7, &&op_8xyE, &&op_9xy0, &&op_Annn, &&op_Bnnn,
+        &&op_Cxkk, &&op_Dxyn, &&op_Ex9E, &&op_ExA1, &&op_F000, &&op_Fn01,
+        &&op_F002, &&op_Fx07, &&op_Fx0A, &&op_Fx15, &&op_Fx18, &&op_Fx1E,
+        &&op_Fx29, &&op_Fx30, &&op_Fx33, &&op_Fx3A, &&op_Fx55, &&op_Fx65,
+        &&op_none
+    };
+    static void* const fused_labels[static_cast<int>(Fusion::Count)] = {
+        &&op_none, &&fused_AnnnDxyn, &&fused_Fx29Dxyn, &&fused_6xkk6xkk,
+        &&fused_6xkk8xy2, &&fused_6xkkExA1, &&fused_3xkk1nnn, &&fused_4xkk1nnn,
+        &&fused_7xkk3xkk, &&fused_Fx073xkk
+    };
+    Instruction instruction {};
+
+#    define DISPATCH()                                         \
+        if (cycles == 0 || (m_events & m_stop_mask))           \
+            return cycles;                                     \
+        --cycles;                                              \
+        instruction = fetch();                                 \
+        if (instruction.fusion != Fusion::None && cycles > 0)  \
+            goto* fused_labels[static_cast<int>(instruction.fusion)]; \
+        goto* labels[static_cast<int>(instruction.operation)]
+#    define HANDLER(name)                          \
+        op_##name : opcode_##name(instruction);    \
+        DISPATCH()
+#    define QUIRK_HANDLER(name)                            \
+        op_##name : opcode_##name<Profile>(instruction);   \
+        DISPATCH()
+#    define FUSED(name)                                        \
+        fused_##name : cycles -= fused_##name(instruction) - 1; \
+        DISPATCH()
+#    define QUIRK_FUSED(name)                                           \
+        fused_##name : cycles -= fused_##name<Profile>(instruction) - 1; \
+        DISPATCH()
+
+    DISPATCH();
+    HANDLER(none);
+    HANDLER(00E0);
+    HANDLER(00EE);
+    QUIRK_HANDLER(00Cn);
+    QUIRK_HANDLER(00Dn);
+    QUIRK_HANDLER(00FB);
+    QUIRK_HANDLER(00FC);
+    QUIRK_HANDLER(00FE);
+    QUIRK_HANDLER(00FF);
+    HANDLER(1nnn);
+    HANDLER(2nnn);
+    QUIRK_HANDLER(3xkk);
+    QUIRK_HANDLER(4xkk);
+    QUIRK_HANDLER(5xy0);
+    QUIRK_HANDLER(5xy2);
+    QUIRK_HANDLER(5xy3);
+    HANDLER(6xkk);
+    HANDLER(7xkk);
+    HANDLER(8xy0);
+    QUIRK_HANDLER(8xy1);
+    QUIRK_HANDLER(8xy2);
+    QUIRK_HANDLER(8xy3);
+    HANDLER(8xy4);
+    HANDLER(8xy5);
+    QUIRK_HANDLER(8xy6);
+    HANDLER(8xy7);
+    QUIRK_HANDLER(8xyE);
+    QUIRK_HANDLER(9xy0);
+    HANDLER(Annn);
+    QUIRK_HANDLER(Bnnn);
+    HANDLER(Cxkk);
+    QUIRK_HANDLER(Dxyn);
+    QUIRK_HANDLER(Ex9E);
+    QUIRK_HANDLER(ExA1);
+    QUIRK_HANDLER(F000);
+    QUIRK_HANDLER(Fn01);
+    QUIRK_HANDLER(F002);
+    HANDLER(Fx07);
+    HANDLER(Fx0A);
+    HANDLER(Fx15);
+    HANDLER(Fx18);
+    HANDLER(Fx1E);
+    HANDLER(Fx29);
+    QUIRK_HANDLER(Fx30);
+    HANDLER(Fx33);
+    QUIRK_HANDLER(Fx3A);
+    QUIRK_HANDLER(Fx55);
+    QUIRK_HANDLER(Fx65);
+    QUIRK_FUSED(AnnnDxyn);
+    QUIRK_FUSED(Fx29Dxyn);
+    FUSED(6xkk6xkk);
+    QUIRK_FUSED(6xkk8xy2);
+    QUIRK_FUSED(6xkkExA1);
+    QUIRK_FUSED(3xkk1nnn);
+    QUIRK_FUSED(4xkk1nnn);
+    QUIRK_FUSED(7xkk3xkk);
+    QUIRK_FUSED(Fx073xkk);
+
+#    undef QUIRK_FUSED
+#    undef FUSED
+#    undef QUIRK_HANDLER
+#    undef HANDLER
+#    undef DISPATCH
+#else
+    while (cycles > 0 && !(m_events & m_stop_mask)) {
+        execute_instruction<Profile>(fetch());
+        --cycles;
+    }
+    return cycles;
+#endif
 }
 
-void Chip8::Cpu::table_8()
+void Chip8::Cpu::opcode_none(const Instruction&)
 {
-    ((*this).*(table8[m_opcode & 0x000Fu]))();
+    m_idle_check.pure = false;
+    m_events |= static_cast<unsigned int>(StopReason::InvalidOpcode);
 }
 
-void Chip8::Cpu::table_e()
+void Chip8::Cpu::table_0(const Instruction& instruction)
 {
-    ((*this).*(tableE[m_opcode & 0x000Fu]))();
+    ((*this).*(table0[instruction.kk]))(instruction);
 }
 
-void Chip8::Cpu::table_f()
+void Chip8::Cpu::table_5(const Instruction& instruction)
 {
-    ((*this).*(tableF[m_opcode & 0x00FFu]))();
+    ((*this).*(table5[instruction.n]))(instruction);
 }
 
-void Chip8::Cpu::opcode_00E0()
+void Chip8::Cpu::table_8(const Instruction& instruction)
+{
+    ((*this).*(table8[instruction.n]))(instruction);
+}
+
+void Chip8::Cpu::table_e(const Instruction& instruction)
+{
+    ((*this).*(tableE[instruction.n]))(instruction);
+}
+
+void Chip8::Cpu::table_f(const Instruction& instruction)
+{
+    ((*this).*(tableF[instruction.kk]))(instruction);
+}
+
+void Chip8::Cpu::opcode_00E0(const Instruction&)
 {
     m_display->clear();
+    m_idle_check.pure = false;
+    m_events |= static_cast<unsigned int>(StopReason::DisplayChanged);
 }
 
-void Chip8::Cpu::opcode_00EE()
+void Chip8::Cpu::opcode_00EE(const Instruction&)
 {
+    if (m_sp == 0) {
+        m_program_counter -= 2;
+        m_events |= static_cast<unsigned int>(StopReason::StackUnderflow);
+        return;
+    }
     --m_sp;
     m_program_counter = m_stack[m_sp];
+    m_idle_check.pure = false;
+}
+
+/**
+ * 00Cn and 00Dn in the profiles without them, matched on the low nibble
+ * like the original dispatch table did, see resolve_operation.
+ */
+void Chip8::Cpu::opcode_00xn(const Instruction& instruction)
+{
+    switch (instruction.n) {
+    case 0x0:
+        opcode_00E0(instruction);
+        break;
+    case 0xE:
+        opcode_00EE(instruction);
+        break;
+    default:
+        opcode_none(instruction);
+        break;
+    }
+}
+
+template<typename Profile>
+void Chip8::Cpu::opcode_00Cn(const Instruction& instruction)
+{
+    if constexpr (!Profile::large_sprites) {
+        opcode_00xn(instruction);
+        return;
+    }
+    m_display->scroll_down(instruction.n);
+    m_idle_check.pure = false;
+    m_events |= static_cast<unsigned int>(StopReason::DisplayChanged);
+}
+
+template<typename Profile>
+void Chip8::Cpu::opcode_00Dn(const Instruction& instruction)
+{
+    if constexpr (!Profile::xo_chip_opcodes) {
+        opcode_00xn(instruction);
+        return;
+    }
+    m_display->scroll_up(instruction.n);
+    m_idle_check.pure = false;
+    m_events |= static_cast<unsigned int>(StopReason::DisplayChanged);
+}
+
+template<typename Profile>
+void Chip8::Cpu::opcode_00FB(const Instruction& instruction)
+{
+    if constexpr (!Profile::large_sprites) {
+        opcode_none(instruction);
+        return;
+    }
+    m_display->scroll_right(4);
+    m_idle_check.pure = false;
+    m_events |= static_cast<unsigned int>(StopReason::DisplayChanged);
+}
+
+template<typename Profile>
+void Chip8::Cpu::opcode_00FC(const Instruction& instruction)
+{
+    if constexpr (!Profile::large_sprites) {
+        opcode_none(instruction);
+        return;
+    }
+    m_display->scroll_left(4);
+    m_idle_check.pure = false;
+    m_events |= static_cast<unsigned int>(StopReason::DisplayChanged);
+}
+
+template<typename Profile>
+void Chip8::Cpu::opcode_00FE(const Instruction& instruction)
+{
+    if constexpr (!Profile::large_sprites) {
+        opcode_00EE(instruction);
+        return;
+    }
+    m_display->set_hires(false);
+    m_idle_check.pure = false;
+    m_events |= static_cast<unsigned int>(StopReason::DisplayChanged);
 }
 
-void Chip8::Cpu::opcode_1nnn()
+template<typename Profile>
+void Chip8::Cpu::opcode_00FF(const Instruction& instruction)
 {
-    uint16_t address = m_opcode & 0x0FFFu;
-    m_program_counter = address;
+    if constexpr (!Profile::large_sprites) {
+        opcode_none(instruction);
+        return;
+    }
+    m_display->set_hires(true);
+    m_idle_check.pure = false;
+    m_events |= static_cast<unsigned int>(StopReason::DisplayChanged);
+}
+
+void Chip8::Cpu::opcode_1nnn(const Instruction& instruction)
+{
+    uint16_t jump_address = m_program_counter - 2;
+    m_program_counter = instruction.nnn;
+    if (instruction.nnn <= jump_address) {
+        check_idle_loop(jump_address);
+    }
 }
 
-void Chip8::Cpu::opcode_2nnn()
+void Chip8::Cpu::opcode_2nnn(const Instruction& instruction)
 {
-    uint16_t address = m_opcode & 0xFFFu;
+    if (m_sp == std::size(m_stack)) {
+        m_program_counter -= 2;
+        m_events |= static_cast<unsigned int>(StopReason::StackOverflow);
+        return;
+    }
     m_stack[m_sp] = m_program_counter;
     ++m_sp;
-    m_program_counter = address;
+    m_program_counter = instruction.nnn;
+    m_idle_check.pure = false;
+}
+
+/**
+ * Steps over the instruction the program counter points at, which is
+ * four bytes long when it is an XO-CHIP F000 NNNN.
+ */
+template<typename Profile>
+void Chip8::Cpu::skip_next()
+{
+    if constexpr (Profile::skips_long_loads) {
+        if (m_memory_manager->get_at_position(m_program_counter) == 0xF000) {
+            m_program_counter += 2;
+        }
+    }
+    m_program_counter += 2;
+}
+
+/**
+ * Only the low nibble of the register picks the key.
+ */
+bool Chip8::Cpu::is_key_down(uint8_t key) const
+{
+    return (m_keypad >> (key & 0xFu)) & 1u;
 }
 
-void Chip8::Cpu::opcode_3xkk()
+template<typename Profile>
+void Chip8::Cpu::opcode_3xkk(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t byte = m_opcode & 0x00FFu;
+    uint8_t vx = instruction.x;
+    uint8_t byte = instruction.kk;
     if (m_registers[vx] == byte) {
-        m_program_counter += 2;
+        skip_next<Profile>();
     }
 }
 
-void Chip8::Cpu::opcode_4xkk()
+template<typename Profile>
+void Chip8::Cpu::opcode_4xkk(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t byte = m_opcode & 0x00FFu;
+    uint8_t vx = instruction.x;
+    uint8_t byte = instruction.kk;
 
     if (m_registers[vx] != byte) {
-        m_program_counter += 2;
+        skip_next<Profile>();
     }
 }
 
-void Chip8::Cpu::opcode_5xy0()
+template<typename Profile>
+void Chip8::Cpu::opcode_5xy0(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (m_opcode & 0x00F0u) >> 4u;
+    uint8_t vx = instruction.x;
+    uint8_t vy = instruction.y;
 
     if (m_registers[vx] == m_registers[vy]) {
-        m_program_counter += 2;
+        skip_next<Profile>();
+    }
+}
+
+/**
+ * 5xy2 and 5xy3 store and load Vx to Vy at I, counting down when y is
+ * below x. I is left alone.
+ */
+template<typename Profile>
+void Chip8::Cpu::opcode_5xy2(const Instruction& instruction)
+{
+    if constexpr (!Profile::xo_chip_opcodes) {
+        opcode_5xy0<Profile>(instruction);
+        return;
+    }
+    int step = instruction.x <= instruction.y ? 1 : -1;
+    unsigned int count = std::abs(instruction.y - instruction.x) + 1;
+
+    for (unsigned int i = 0; i < count; ++i) {
+        m_memory_manager->set_value(m_address_register + i, m_registers[instruction.x + step * static_cast<int>(i)]);
+    }
+    m_idle_check.pure = false;
+}
+
+template<typename Profile>
+void Chip8::Cpu::opcode_5xy3(const Instruction& instruction)
+{
+    if constexpr (!Profile::xo_chip_opcodes) {
+        opcode_5xy0<Profile>(instruction);
+        return;
+    }
+    int step = instruction.x <= instruction.y ? 1 : -1;
+    unsigned int count = std::abs(instruction.y - instruction.x) + 1;
+
+    for (unsigned int i = 0; i < count; ++i) {
+        m_registers[instruction.x + step * static_cast<int>(i)] = m_memory_manager->get_value(m_address_register + i);
     }
 }
 
-void Chip8::Cpu::opcode_6xkk()
+void Chip8::Cpu::opcode_6xkk(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t byte = m_opcode & 0x00FFu;
+    uint8_t vx = instruction.x;
+    uint8_t byte = instruction.kk;
 
     m_registers[vx] = byte;
 }
 
-void Chip8::Cpu::opcode_7xkk()
+void Chip8::Cpu::opcode_7xkk(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t byte = m_opcode & 0x00FFu;
+    uint8_t vx = instruction.x;
+    uint8_t byte = instruction.kk;
 
     m_registers[vx] += byte;
 }
 
-void Chip8::Cpu::opcode_8xy0()
+void Chip8::Cpu::opcode_8xy0(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (m_opcode & 0x00F0u) >> 4u;
+    uint8_t vx = instruction.x;
+    uint8_t vy = instruction.y;
 
     m_registers[vx] = m_registers[vy];
 }
 
-void Chip8::Cpu::opcode_8xy1()
+template<typename Profile>
+void Chip8::Cpu::opcode_8xy1(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (m_opcode & 0x00F0u) >> 4u;
+    uint8_t vx = instruction.x;
+    uint8_t vy = instruction.y;
 
     m_registers[vx] |= m_registers[vy];
+    if constexpr (Profile::logic_resets_vf) {
+        m_registers[0xF] = 0;
+    }
 }
 
-void Chip8::Cpu::opcode_8xy2()
+template<typename Profile>
+void Chip8::Cpu::opcode_8xy2(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (m_opcode & 0x00F0u) >> 4u;
+    uint8_t vx = instruction.x;
+    uint8_t vy = instruction.y;
 
     m_registers[vx] &= m_registers[vy];
+    if constexpr (Profile::logic_resets_vf) {
+        m_registers[0xF] = 0;
+    }
 }
 
-void Chip8::Cpu::opcode_8xy3()
+template<typename Profile>
+void Chip8::Cpu::opcode_8xy3(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (m_opcode & 0x00F0u) >> 4u;
+    uint8_t vx = instruction.x;
+    uint8_t vy = instruction.y;
 
     m_registers[vx] ^= m_registers[vy];
+    if constexpr (Profile::logic_resets_vf) {
+        m_registers[0xF] = 0;
+    }
 }
 
-void Chip8::Cpu::opcode_8xy4()
+void Chip8::Cpu::opcode_8xy4(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (m_opcode & 0x00F0u) >> 4u;
+    uint8_t vx = instruction.x;
+    uint8_t vy = instruction.y;
 
     uint16_t sum = m_registers[vx] + m_registers[vy];
 
@@ -263,10 +1278,10 @@ void Chip8::Cpu::opcode_8xy4()
     m_registers[vx] = sum & 0xFFu;
 }
 
-void Chip8::Cpu::opcode_8xy5()
+void Chip8::Cpu::opcode_8xy5(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (m_opcode & 0x00F0u) >> 4u;
+    uint8_t vx = instruction.x;
+    uint8_t vy = instruction.y;
 
     if (m_registers[vx] > m_registers[vy]) {
         m_registers[0xF] = 1;
@@ -277,19 +1292,21 @@ void Chip8::Cpu::opcode_8xy5()
     m_registers[vx] -= m_registers[vy];
 }
 
-void Chip8::Cpu::opcode_8xy6()
+template<typename Profile>
+void Chip8::Cpu::opcode_8xy6(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
+    uint8_t source = Profile::shift_uses_vy ? instruction.y : vx;
 
-    m_registers[0xF] = (m_registers[vx] & 0x1u);
+    m_registers[0xF] = (m_registers[source] & 0x1u);
 
-    m_registers[vx] >>= 1;
+    m_registers[vx] = m_registers[source] >> 1;
 }
 
-void Chip8::Cpu::opcode_8xy7()
+void Chip8::Cpu::opcode_8xy7(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (m_opcode & 0x00F0u) >> 4u;
+    uint8_t vx = instruction.x;
+    uint8_t vy = instruction.y;
 
     if (m_registers[vy] > m_registers[vx]) {
         m_registers[0xF] = 1;
@@ -300,210 +1317,210 @@ void Chip8::Cpu::opcode_8xy7()
     m_registers[vx] = m_registers[vy] - m_registers[vx];
 }
 
-void Chip8::Cpu::opcode_8xyE()
+template<typename Profile>
+void Chip8::Cpu::opcode_8xyE(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
+    uint8_t source = Profile::shift_uses_vy ? instruction.y : vx;
 
-    m_registers[0xF] = (m_registers[vx] & 0x80u) >> 7u;
+    m_registers[0xF] = (m_registers[source] & 0x80u) >> 7u;
 
-    m_registers[vx] <<= 1;
+    m_registers[vx] = m_registers[source] << 1;
 }
 
-void Chip8::Cpu::opcode_9xy0()
+template<typename Profile>
+void Chip8::Cpu::opcode_9xy0(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (m_opcode & 0x00F0u) >> 4u;
+    uint8_t vx = instruction.x;
+    uint8_t vy = instruction.y;
 
     if (m_registers[vx] != m_registers[vy]) {
-        m_program_counter += 2;
+        skip_next<Profile>();
     }
 }
 
-void Chip8::Cpu::opcode_Annn()
+void Chip8::Cpu::opcode_Annn(const Instruction& instruction)
 {
-    uint16_t address = m_opcode & 0x0FFFu;
-
-    m_address_register = address;
+    m_address_register = instruction.nnn;
 }
 
-void Chip8::Cpu::opcode_Bnnn()
+template<typename Profile>
+void Chip8::Cpu::opcode_Bnnn(const Instruction& instruction)
 {
-    uint16_t address = m_opcode & 0x0FFFu;
-
-    m_program_counter = m_registers[0] + address;
+    m_program_counter = m_registers[Profile::jump_uses_vx ? instruction.x : 0] + instruction.nnn;
 }
 
-void Chip8::Cpu::opcode_Cxkk()
+void Chip8::Cpu::opcode_Cxkk(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t byte = m_opcode & 0x00FFu;
+    uint8_t vx = instruction.x;
+    uint8_t byte = instruction.kk;
 
-    m_registers[vx] = m_random_byte(m_random_generator) & byte;
+    m_registers[vx] = m_random.next_byte() & byte;
+    m_idle_check.pure = false;
 }
 
-void Chip8::Cpu::opcode_Dxyn()
+template<typename Profile>
+void Chip8::Cpu::opcode_Dxyn(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (m_opcode & 0x00F0u) >> 4u;
-    uint8_t height = m_opcode & 0x000Fu;
+    uint8_t vx = instruction.x;
+    uint8_t vy = instruction.y;
+    uint8_t height = instruction.n;
+
+    uint8_t x_pos = m_registers[vx] & (m_display->get_mode_width() - 1);
+    uint8_t y_pos = m_registers[vy] & (m_display->get_mode_height() - 1);
+
+    // Dxy0 is the 16x16 SUPER-CHIP sprite, two bytes per row, and every
+    // selected XO-CHIP plane takes the next sprite from memory. Without
+    // large sprites Dxy0 draws no rows at all.
+    bool large = Profile::large_sprites && height == 0;
+    unsigned int size = (large ? 32 : height) * m_display->get_plane_count();
+    uint8_t sprite[32 * DisplayBuffer::PLANE_COUNT];
+    for (unsigned int i = 0; i < size; ++i) {
+        sprite[i] = m_memory_manager->get_value(m_address_register + i);
+    }
 
-    uint8_t x_pos = m_registers[vx] % 64;
-    uint8_t y_pos = m_registers[vy] % 32;
+    bool collision = large
+        ? m_display->draw_large_sprite<Profile::sprites_wrap>(x_pos, y_pos, sprite)
+        : m_display->draw_sprite<Profile::sprites_wrap>(x_pos, y_pos, sprite, height);
+    m_registers[0xF] = collision ? 1 : 0;
+    m_idle_check.pure = false;
+    m_events |= static_cast<unsigned int>(StopReason::DisplayChanged);
+}
 
-    m_registers[0xF] = 0;
+template<typename Profile>
+void Chip8::Cpu::opcode_Ex9E(const Instruction& instruction)
+{
+    uint8_t vx = instruction.x;
 
-    for (unsigned int row = 0; row < height; ++row) {
-        uint8_t sprite_byte = m_memory_manager->get_value(m_address_register + row);
-        for (unsigned int col = 0; col < 8; ++col) {
-            uint8_t sprite_pixel = sprite_byte & (0x80u >> col);
-            uint32_t * screen_pixel = &m_display->get_display_data()[(y_pos + row) * 64 + (x_pos + col)];
-            if (sprite_pixel) {
-                if (*screen_pixel == 0xFFFFFFFF)
-                {
-                    m_registers[0xF] = 1;
-                }
+    uint8_t key = m_registers[vx];
 
-                *screen_pixel ^= 0xFFFFFFFF;
-            }
-        }
+    if (is_key_down(key)) {
+        skip_next<Profile>();
     }
 }
 
-void Chip8::Cpu::opcode_Ex9E()
+template<typename Profile>
+void Chip8::Cpu::opcode_ExA1(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
 
     uint8_t key = m_registers[vx];
 
-    if (m_keypad[key]) {
-        m_program_counter += 2;
+    if (!is_key_down(key)) {
+        skip_next<Profile>();
     }
 }
 
-void Chip8::Cpu::opcode_ExA1()
+/**
+ * F000 NNNN loads I from the word behind it, the only way to point I
+ * above the 12 bit range.
+ */
+template<typename Profile>
+void Chip8::Cpu::opcode_F000(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    if constexpr (!Profile::xo_chip_opcodes) {
+        opcode_none(instruction);
+        return;
+    }
+    m_address_register = m_memory_manager->get_at_position(m_program_counter);
+    m_program_counter += 2;
+}
 
-    uint8_t key = m_registers[vx];
+template<typename Profile>
+void Chip8::Cpu::opcode_Fn01(const Instruction& instruction)
+{
+    if constexpr (!Profile::xo_chip_opcodes) {
+        opcode_none(instruction);
+        return;
+    }
+    m_display->select_planes(instruction.x);
+    m_idle_check.pure = false;
+}
 
-    if (!m_keypad[key]) {
-        m_program_counter += 2;
+template<typename Profile>
+void Chip8::Cpu::opcode_F002(const Instruction& instruction)
+{
+    if constexpr (!Profile::xo_chip_opcodes) {
+        opcode_none(instruction);
+        return;
     }
+    for (unsigned int i = 0; i < AUDIO_PATTERN_SIZE; ++i) {
+        m_audio_pattern[i] = m_memory_manager->get_value(m_address_register + i);
+    }
+    m_idle_check.pure = false;
 }
 
-void Chip8::Cpu::opcode_Fx07()
+void Chip8::Cpu::opcode_Fx07(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
 
     m_registers[vx] = m_delay_timer;
 }
 
-void Chip8::Cpu::opcode_Fx0A()
+/**
+ * Takes the lowest key held down, the same one the old scan over all
+ * sixteen keys found first.
+ */
+void Chip8::Cpu::opcode_Fx0A(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
 
-    if (m_keypad[0])
-    {
-        m_registers[vx] = 0;
-    }
-    else if (m_keypad[1])
-    {
-        m_registers[vx] = 1;
-    }
-    else if (m_keypad[2])
-    {
-        m_registers[vx] = 2;
-    }
-    else if (m_keypad[3])
-    {
-        m_registers[vx] = 3;
-    }
-    else if (m_keypad[4])
-    {
-        m_registers[vx] = 4;
-    }
-    else if (m_keypad[5])
-    {
-        m_registers[vx] = 5;
-    }
-    else if (m_keypad[6])
-    {
-        m_registers[vx] = 6;
-    }
-    else if (m_keypad[7])
-    {
-        m_registers[vx] = 7;
-    }
-    else if (m_keypad[8])
-    {
-        m_registers[vx] = 8;
-    }
-    else if (m_keypad[9])
-    {
-        m_registers[vx] = 9;
-    }
-    else if (m_keypad[10])
-    {
-        m_registers[vx] = 10;
-    }
-    else if (m_keypad[11])
-    {
-        m_registers[vx] = 11;
-    }
-    else if (m_keypad[12])
-    {
-        m_registers[vx] = 12;
-    }
-    else if (m_keypad[13])
-    {
-        m_registers[vx] = 13;
-    }
-    else if (m_keypad[14])
-    {
-        m_registers[vx] = 14;
-    }
-    else if (m_keypad[15])
-    {
-        m_registers[vx] = 15;
-    }
-    else
-    {
+    if (m_keypad != 0) {
+        m_registers[vx] = std::countr_zero(m_keypad);
+    } else {
         m_program_counter -= 2;
+        m_idle_check.jump_address = m_program_counter;
+        m_events |= static_cast<unsigned int>(StopReason::WaitingForKey);
     }
 }
 
-void Chip8::Cpu::opcode_Fx15()
+void Chip8::Cpu::opcode_Fx15(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
 
     m_delay_timer = m_registers[vx];
+    m_idle_check.pure = false;
 }
 
-void Chip8::Cpu::opcode_Fx18()
+void Chip8::Cpu::opcode_Fx18(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
 
     m_sound_timer = m_registers[vx];
+    m_idle_check.pure = false;
 }
 
-void Chip8::Cpu::opcode_Fx1E()
+void Chip8::Cpu::opcode_Fx1E(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
 
     m_address_register += m_registers[vx];
 }
 
-void Chip8::Cpu::opcode_Fx29()
+void Chip8::Cpu::opcode_Fx29(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
     uint8_t digit = m_registers[vx];
 
     m_address_register = 0x50 + (5 * digit);
 }
 
-void Chip8::Cpu::opcode_Fx33()
+template<typename Profile>
+void Chip8::Cpu::opcode_Fx30(const Instruction& instruction)
+{
+    if constexpr (!Profile::large_sprites) {
+        opcode_none(instruction);
+        return;
+    }
+    uint8_t vx = instruction.x;
+    uint8_t digit = m_registers[vx] & 0xFu;
+
+    m_address_register = MemoryManager::LARGE_FONT_ADDRESS + (10 * digit);
+}
+
+void Chip8::Cpu::opcode_Fx33(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
     uint8_t value = m_registers[vx];
 
     m_memory_manager->set_value(m_address_register + 2, value % 10);
@@ -513,27 +1530,201 @@ void Chip8::Cpu::opcode_Fx33()
     value /= 10;
 
     m_memory_manager->set_value(m_address_register, value % 10);
+    m_idle_check.pure = false;
+}
+
+template<typename Profile>
+void Chip8::Cpu::opcode_Fx3A(const Instruction& instruction)
+{
+    if constexpr (!Profile::xo_chip_opcodes) {
+        opcode_none(instruction);
+        return;
+    }
+    m_pitch = m_registers[instruction.x];
+    m_idle_check.pure = false;
 }
 
-void Chip8::Cpu::opcode_Fx55()
+template<typename Profile>
+void Chip8::Cpu::opcode_Fx55(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
 
     for (uint8_t i = 0; i <= vx; ++i) {
         m_memory_manager->set_value(m_address_register + i, m_registers[i]);
     }
+    if constexpr (Profile::load_store_increments_i) {
+        m_address_register += vx + 1;
+    }
+    m_idle_check.pure = false;
 }
 
-void Chip8::Cpu::opcode_Fx65()
+template<typename Profile>
+void Chip8::Cpu::opcode_Fx65(const Instruction& instruction)
 {
-    uint8_t vx = (m_opcode & 0x0F00u) >> 8u;
+    uint8_t vx = instruction.x;
 
     for (uint8_t i = 0; i <= vx; ++i) {
         m_registers[i] = m_memory_manager->get_value(m_address_register + i);
     }
+    if constexpr (Profile::load_store_increments_i) {
+        m_address_register += vx + 1;
+    }
+}
+
+/**
+ * The second instruction of a fused pair, decoded along with the first.
+ * Moves the program counter behind it like fetch does.
+ */
+Chip8::Instruction Chip8::Cpu::fetch_fused()
+{
+    Instruction instruction = m_memory_manager->get_decoded(m_program_counter);
+    m_program_counter += 2;
+    return instruction;
+}
+
+/**
+ * The fused handlers run both halves through the regular handlers and
+ * return how many instructions were executed, a taken skip leaves the
+ * second one out.
+ */
+template<typename Profile>
+unsigned int Chip8::Cpu::fused_AnnnDxyn(const Instruction& instruction)
+{
+    opcode_Annn(instruction);
+    opcode_Dxyn<Profile>(fetch_fused());
+    return 2;
+}
+
+template<typename Profile>
+unsigned int Chip8::Cpu::fused_Fx29Dxyn(const Instruction& instruction)
+{
+    opcode_Fx29(instruction);
+    opcode_Dxyn<Profile>(fetch_fused());
+    return 2;
+}
+
+unsigned int Chip8::Cpu::fused_6xkk6xkk(const Instruction& instruction)
+{
+    opcode_6xkk(instruction);
+    opcode_6xkk(fetch_fused());
+    return 2;
+}
+
+template<typename Profile>
+unsigned int Chip8::Cpu::fused_6xkk8xy2(const Instruction& instruction)
+{
+    opcode_6xkk(instruction);
+    opcode_8xy2<Profile>(fetch_fused());
+    return 2;
+}
+
+template<typename Profile>
+unsigned int Chip8::Cpu::fused_6xkkExA1(const Instruction& instruction)
+{
+    opcode_6xkk(instruction);
+    opcode_ExA1<Profile>(fetch_fused());
+    return 2;
+}
+
+template<typename Profile>
+unsigned int Chip8::Cpu::fused_3xkk1nnn(const Instruction& instruction)
+{
+    uint16_t next = m_program_counter;
+    opcode_3xkk<Profile>(instruction);
+    if (m_program_counter != next) {
+        return 1;
+    }
+    opcode_1nnn(fetch_fused());
+    return 2;
+}
+
+template<typename Profile>
+unsigned int Chip8::Cpu::fused_4xkk1nnn(const Instruction& instruction)
+{
+    uint16_t next = m_program_counter;
+    opcode_4xkk<Profile>(instruction);
+    if (m_program_counter != next) {
+        return 1;
+    }
+    opcode_1nnn(fetch_fused());
+    return 2;
+}
+
+template<typename Profile>
+unsigned int Chip8::Cpu::fused_7xkk3xkk(const Instruction& instruction)
+{
+    opcode_7xkk(instruction);
+    opcode_3xkk<Profile>(fetch_fused());
+    return 2;
+}
+
+template<typename Profile>
+unsigned int Chip8::Cpu::fused_Fx073xkk(const Instruction& instruction)
+{
+    opcode_Fx07(instruction);
+    opcode_3xkk<Profile>(fetch_fused());
+    return 2;
 }
 
-uint8_t* Chip8::Cpu::get_keypad()
+uint16_t Chip8::Cpu::get_keypad_mask() const
 {
     return m_keypad;
 }
+
+/**
+ * The keypad only changes between run_until calls, the frontends latch
+ * their input once per frame so replays see the same keys at the same
+ * cycle.
+ */
+void Chip8::Cpu::set_keypad_mask(uint16_t keys)
+{
+    if (keys != m_keypad) {
+        // a loop polling the keys may take another path from now on
+        m_idle_check.pure = false;
+    }
+    m_keypad = keys;
+}
+
+void Chip8::Cpu::set_seed(u64 seed)
+{
+    m_random.seed(seed);
+}
+
+void Chip8::Cpu::save_state(CpuState& state) const
+{
+    std::copy(std::begin(m_registers), std::end(m_registers), state.registers);
+    state.address_register = m_address_register;
+    state.program_counter = m_program_counter;
+    std::copy(std::begin(m_stack), std::end(m_stack), state.stack);
+    state.sp = m_sp;
+    state.delay_timer = m_delay_timer;
+    state.sound_timer = m_sound_timer;
+    state.keypad = m_keypad;
+    std::copy(std::begin(m_audio_pattern), std::end(m_audio_pattern), state.audio_pattern);
+    state.pitch = m_pitch;
+    state.frame_cycle = m_frame_cycle;
+    state.cycle_count = m_cycle_count;
+    state.frame_count = m_frame_count;
+    state.random_state = m_random.get_state();
+    state.quirks = m_quirks;
+    state.cycles_per_frame = m_cycles_per_frame;
+}
+
+void Chip8::Cpu::load_state(const CpuState& state)
+{
+    std::copy(std::begin(state.registers), std::end(state.registers), m_registers);
+    m_address_register = state.address_register;
+    m_program_counter = state.program_counter;
+    std::copy(std::begin(state.stack), std::end(state.stack), m_stack);
+    m_sp = state.sp;
+    m_delay_timer = state.delay_timer;
+    m_sound_timer = state.sound_timer;
+    m_keypad = state.keypad;
+    std::copy(std::begin(state.audio_pattern), std::end(state.audio_pattern), m_audio_pattern);
+    m_pitch = state.pitch;
+    m_frame_cycle = state.frame_cycle < m_cycles_per_frame ? state.frame_cycle : 0;
+    m_cycle_count = state.cycle_count;
+    m_frame_count = state.frame_count;
+    m_random.set_state(state.random_state);
+    m_idle_check.pure = false;
+}
@@ -23,62 +23,278 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 #include "DisplayBuffer.h"
+#include "Instruction.h"
+#include "Jit.h"
 #include "Memory.h"
+#include "Quirks.h"
+#include "Random.h"
+#include "Recompiled.h"
+#ifdef CHIP8_PROFILER
+#    include "Profiler.h"
+#endif
 #include <memory>
-#include <random>
+#include <string>
 
 namespace Chip8 {
     const unsigned int KEY_COUNT = 16;
+    // the XO-CHIP sound is a 128 bit pattern played as a loop
+    const unsigned int AUDIO_PATTERN_SIZE = 16;
+    const uint8_t DEFAULT_PITCH = 64;
 
-    class Cpu final {
+    /**
+     * Table is the original two level pointer-to-member dispatch,
+     * Switch decodes into an Operation and switches over it and
+     * Threaded does the same with computed gotos where the compiler
+     * supports them (falling back to Switch otherwise). Jit translates
+     * blocks into native code on x86-64 Linux and is replaced by Threaded
+     * everywhere else.
+     */
+    enum class CpuCore {
+        Table,
+        Switch,
+        Threaded,
+        Jit
+    };
+
+    const char* to_string(CpuCore core);
+    bool parse_core(const std::string& name, CpuCore& core);
+
+    /**
+     * Why run_cycles / run_until returned. Apart from BudgetExhausted
+     * every reason is a single bit so they can be combined into the
+     * mask run_until takes. The faults always stop execution, the
+     * other events only when they are part of the mask.
+     */
+    enum class StopReason : unsigned int {
+        BudgetExhausted = 0,
+        FrameBoundary = 1u << 0u,
+        WaitingForKey = 1u << 1u,
+        DisplayChanged = 1u << 2u,
+        InvalidOpcode = 1u << 3u,
+        StackOverflow = 1u << 4u,
+        StackUnderflow = 1u << 5u
+    };
+
+    constexpr unsigned int operator|(StopReason lhs, StopReason rhs)
+    {
+        return static_cast<unsigned int>(lhs) | static_cast<unsigned int>(rhs);
+    }
+
+    constexpr unsigned int operator|(unsigned int lhs, StopReason rhs)
+    {
+        return lhs | static_cast<unsigned int>(rhs);
+    }
+
+    const unsigned int FAULT_EVENTS = StopReason::InvalidOpcode | StopReason::StackOverflow | StopReason::StackUnderflow;
+
+    // a frame is 1/60 s of emulated time, the delay and sound timers
+    // count down once per frame no matter how fast the host runs
+    const unsigned int FRAMES_PER_SECOND = 60;
+    const unsigned int DEFAULT_CYCLES_PER_FRAME = 10;
+
+    struct RunResult {
+        StopReason reason;
+        u64 cycles;
+    };
+
+    const char* to_string(StopReason reason);
+
+    /**
+     * Everything that makes up the state of the Cpu, plain data so it can
+     * be copied around cheaply for snapshots.
+     */
+    struct CpuState {
+        uint8_t registers[16];
+        uint16_t address_register;
+        uint16_t program_counter;
+        uint16_t stack[16];
+        uint8_t sp;
+        uint8_t delay_timer;
+        uint8_t sound_timer;
+        // one bit per key, key 0 in the lowest bit
+        uint16_t keypad;
+        uint8_t audio_pattern[AUDIO_PATTERN_SIZE];
+        uint8_t pitch;
+        uint32_t frame_cycle;
+        u64 cycle_count;
+        u64 frame_count;
+        u64 random_state;
+        // a state only resumes on a cpu with the same quirks and frame length
+        QuirkProfile quirks;
+        uint32_t cycles_per_frame;
+    };
+
+    class alignas(CACHE_LINE_SIZE) Cpu final {
     public:
         Cpu(std::shared_ptr<MemoryManager> memory_manager, std::shared_ptr<DisplayBuffer> display);
         void dump();
         void core_dump();
         void execute();
-        uint8_t * get_keypad();
+        RunResult run_cycles(u64 budget);
+        RunResult run_until(unsigned int events, u64 budget);
+        void set_core(CpuCore core);
+        CpuCore get_core() const;
+        void set_cycles_per_frame(unsigned int cycles);
+        unsigned int get_cycles_per_frame() const;
+        u64 get_cycle_count() const;
+        u64 get_frame_count() const;
+        uint8_t get_delay_timer() const;
+        uint8_t get_sound_timer() const;
+        const uint8_t* get_audio_pattern() const;
+        uint8_t get_pitch() const;
+        bool is_sound_active() const;
+        void set_idle_skipping(bool enabled);
+        void set_fusion(bool enabled);
+        void set_quirks(QuirkProfile profile);
+        QuirkProfile get_quirks() const;
+        u64 get_idle_cycles() const;
+        JitStats get_jit_stats() const;
+        bool load_recompiled(const std::string& file);
+        bool is_recompiled_active() const;
+        uint16_t get_keypad_mask() const;
+        void set_keypad_mask(uint16_t keys);
+        void set_seed(u64 seed);
+        void save_state(CpuState& state) const;
+        void load_state(const CpuState& state);
+#ifdef CHIP8_PROFILER
+        Profiler& get_profiler();
+#endif
+
+        static CpuCore default_core();
 
     private:
-        void table_0();
-        void table_8();
-        void table_e();
-        void table_f();
-
-        void opcode_none();
-        void opcode_00E0();
-        void opcode_00EE();
-        void opcode_1nnn();
-        void opcode_2nnn();
-        void opcode_3xkk();
-        void opcode_4xkk();
-        void opcode_5xy0();
-        void opcode_6xkk();
-        void opcode_7xkk();
-        void opcode_8xy0();
-        void opcode_8xy1();
-        void opcode_8xy2();
-        void opcode_8xy3();
-        void opcode_8xy4();
-        void opcode_8xy5();
-        void opcode_8xy6();
-        void opcode_8xy7();
-        void opcode_8xyE();
-        void opcode_9xy0();
-        void opcode_Annn();
-        void opcode_Bnnn();
-        void opcode_Cxkk();
-        void opcode_Dxyn();
-        void opcode_Ex9E();
-        void opcode_ExA1();
-        void opcode_Fx07();
-        void opcode_Fx0A();
-        void opcode_Fx15();
-        void opcode_Fx18();
-        void opcode_Fx1E();
-        void opcode_Fx29();
-        void opcode_Fx33();
-        void opcode_Fx55();
-        void opcode_Fx65();
+        friend class Jit;
+        friend class RecompiledProgram;
+
+        Instruction fetch();
+        u64 execute_block(u64 cycles);
+        u64 dispatch_block(u64 cycles);
+        template<typename Profile>
+        u64 run_core(u64 cycles);
+#ifdef CHIP8_PROFILER
+        u64 execute_profiled(u64 cycles);
+#endif
+        void execute_table();
+        void execute_switch();
+        void execute_instruction(const Instruction& instruction);
+        template<typename Profile>
+        void execute_instruction(const Instruction& instruction);
+        template<typename Profile>
+        unsigned int execute_fused(const Instruction& instruction);
+        Instruction fetch_fused();
+        template<typename Profile>
+        u64 execute_threaded(u64 cycles);
+        template<typename Profile>
+        void build_tables();
+        void end_frame();
+        static StopReason reason_for(unsigned int events);
+        void check_idle_loop(uint16_t jump_address);
+        template<typename Profile>
+        void skip_next();
+        bool is_key_down(uint8_t key) const;
+        u64 fast_forward_idle_loop(u64 remaining);
+
+        void table_0(const Instruction& instruction);
+        void table_5(const Instruction& instruction);
+        void table_8(const Instruction& instruction);
+        void table_e(const Instruction& instruction);
+        void table_f(const Instruction& instruction);
+
+        void opcode_none(const Instruction& instruction);
+        void opcode_00E0(const Instruction& instruction);
+        void opcode_00EE(const Instruction& instruction);
+        void opcode_00xn(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_00Cn(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_00Dn(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_00FB(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_00FC(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_00FE(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_00FF(const Instruction& instruction);
+        void opcode_1nnn(const Instruction& instruction);
+        void opcode_2nnn(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_3xkk(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_4xkk(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_5xy0(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_5xy2(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_5xy3(const Instruction& instruction);
+        void opcode_6xkk(const Instruction& instruction);
+        void opcode_7xkk(const Instruction& instruction);
+        void opcode_8xy0(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_8xy1(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_8xy2(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_8xy3(const Instruction& instruction);
+        void opcode_8xy4(const Instruction& instruction);
+        void opcode_8xy5(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_8xy6(const Instruction& instruction);
+        void opcode_8xy7(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_8xyE(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_9xy0(const Instruction& instruction);
+        void opcode_Annn(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_Bnnn(const Instruction& instruction);
+        void opcode_Cxkk(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_Dxyn(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_Ex9E(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_ExA1(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_F000(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_Fn01(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_F002(const Instruction& instruction);
+        void opcode_Fx07(const Instruction& instruction);
+        void opcode_Fx0A(const Instruction& instruction);
+        void opcode_Fx15(const Instruction& instruction);
+        void opcode_Fx18(const Instruction& instruction);
+        void opcode_Fx1E(const Instruction& instruction);
+        void opcode_Fx29(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_Fx30(const Instruction& instruction);
+        void opcode_Fx33(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_Fx3A(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_Fx55(const Instruction& instruction);
+        template<typename Profile>
+        void opcode_Fx65(const Instruction& instruction);
+
+        template<typename Profile>
+        unsigned int fused_AnnnDxyn(const Instruction& instruction);
+        template<typename Profile>
+        unsigned int fused_Fx29Dxyn(const Instruction& instruction);
+        unsigned int fused_6xkk6xkk(const Instruction& instruction);
+        template<typename Profile>
+        unsigned int fused_6xkk8xy2(const Instruction& instruction);
+        template<typename Profile>
+        unsigned int fused_6xkkExA1(const Instruction& instruction);
+        template<typename Profile>
+        unsigned int fused_3xkk1nnn(const Instruction& instruction);
+        template<typename Profile>
+        unsigned int fused_4xkk1nnn(const Instruction& instruction);
+        template<typename Profile>
+        unsigned int fused_7xkk3xkk(const Instruction& instruction);
+        template<typename Profile>
+        unsigned int fused_Fx073xkk(const Instruction& instruction);
 
     private:
         std::shared_ptr<MemoryManager> m_memory_manager;
@@ -86,23 +302,65 @@ namespace Chip8 {
 
         uint8_t m_delay_timer{};
         uint8_t m_sound_timer{};
+        uint8_t m_audio_pattern[AUDIO_PATTERN_SIZE] {};
+        uint8_t m_pitch = DEFAULT_PITCH;
+        // whether the sound timer was running when the last frame ended
+        bool m_sound_active = false;
 
-        std::default_random_engine m_random_generator;
-        std::uniform_int_distribution<uint8_t> m_random_byte;
+        Random m_random;
         uint8_t m_registers[16] {};
         uint16_t m_address_register {};
         uint16_t m_program_counter = 0x200;
         uint16_t m_stack[16] {};
         uint8_t m_sp{};
         uint16_t m_opcode{};
+        CpuCore m_core = default_core();
+        QuirkProfile m_quirks = QuirkProfile::Modern;
+
+        // set by the handlers, checked by the dispatch loops against
+        // m_stop_mask after every instruction
+        unsigned int m_events = 0;
+        unsigned int m_stop_mask = FAULT_EVENTS;
+
+        // raised when a loop came back to a backward jump without having
+        // changed anything, internal only and never returned to callers
+        static constexpr unsigned int EVENT_IDLE_LOOP = 1u << 16u;
+        static constexpr unsigned int IDLE_EVENTS = EVENT_IDLE_LOOP | static_cast<unsigned int>(StopReason::WaitingForKey);
+
+        // machine state at the last backward jump, pure is cleared by every
+        // handler that touches anything but the registers and I
+        struct IdleLoopCheck {
+            uint16_t jump_address;
+            uint16_t address_register;
+            uint8_t registers[16];
+            bool pure;
+        };
+        IdleLoopCheck m_idle_check {};
+        bool m_idle_skipping = true;
+        u64 m_idle_cycles = 0;
+        unsigned int m_cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+        unsigned int m_frame_cycle = 0;
+        u64 m_cycle_count = 0;
+        u64 m_frame_count = 0;
+
+        // one bit per key, key 0 in the lowest bit
+        uint16_t m_keypad = 0;
+
+        // created on first use of the Jit core
+        std::unique_ptr<Jit> m_jit;
+        // takes precedence over the selected core while it is active
+        std::unique_ptr<RecompiledProgram> m_recompiled;
 
-        uint8_t m_keypad[KEY_COUNT]{};
+#ifdef CHIP8_PROFILER
+        Profiler m_profiler;
+#endif
 
-        typedef void (Cpu::*OpCodeFunc)();
-        OpCodeFunc table[0xF + 1]{&Cpu::opcode_none};
-        OpCodeFunc table0[0xE + 1]{&Cpu::opcode_none};
-        OpCodeFunc table8[0xE + 1]{&Cpu::opcode_none};
-        OpCodeFunc tableE[0xE + 1]{&Cpu::opcode_none};
-        OpCodeFunc tableF[0x65 + 1]{&Cpu::opcode_none};
+        typedef void (Cpu::*OpCodeFunc)(const Instruction&);
+        OpCodeFunc table[0xF + 1]{};
+        OpCodeFunc table0[0xFF + 1]{};
+        OpCodeFunc table5[0xF + 1]{};
+        OpCodeFunc table8[0xF + 1]{};
+        OpCodeFunc tableE[0xF + 1]{};
+        OpCodeFunc tableF[0xFF + 1]{};
     };
 }
\ No newline at end of file
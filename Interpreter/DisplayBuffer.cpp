@@ -23,62 +23,368 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "DisplayBuffer.h"
 #include <Types.h>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
 
+static uint64_t pixel_mask(int x)
+{
+    return 0x8000000000000000ull >> x;
+}
+
+// one row of the sprite, left aligned in a word
+template<unsigned int Width>
+static uint64_t sprite_row(const uint8_t* sprite, unsigned int row)
+{
+    if constexpr (Width == 16) {
+        return static_cast<uint64_t>(sprite[2 * row] << 8u | sprite[2 * row + 1]) << 48u;
+    } else {
+        return static_cast<uint64_t>(sprite[row]) << 56u;
+    }
+}
+
 void Chip8::DisplayBuffer::apply_display_data(const unsigned short* new_display_data)
 {
-    for (size_t i = 0; i < 32 * 64; i++) {
-        unsigned short current_value = m_display_data[i];
-        unsigned short new_value = new_display_data[i];
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        for (int x = 0; x < DISPLAY_WIDTH; x++) {
+            if (new_display_data[y * DISPLAY_WIDTH + x]) {
+                m_rows[0][y][0] ^= pixel_mask(x);
+            }
+        }
+    }
+    ++m_generation;
+}
+
+/**
+ * XORs height rows of 8 pixels onto the display starting at (x, y), which
+ * have to be on screen, and returns whether any pixel that was set got
+ * cleared. Pixels going over the right or bottom edge are clipped or,
+ * with Wrap, come back in on the opposite one.
+ */
+template<bool Wrap>
+bool Chip8::DisplayBuffer::draw_sprite(unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height)
+{
+    return draw<8, Wrap>(x, y, sprite, height);
+}
 
-        unsigned short ored = current_value | new_value;
-        unsigned short neg_ored = ~current_value | ~new_value;
-        m_display_data[i] = ored & neg_ored;
+/**
+ * The SUPER-CHIP Dxy0 sprite, 16x16 pixels stored as two bytes per row.
+ */
+template<bool Wrap>
+bool Chip8::DisplayBuffer::draw_large_sprite(unsigned int x, unsigned int y, const uint8_t* sprite)
+{
+    return draw<16, Wrap>(x, y, sprite, 16);
+}
+
+template<unsigned int Width, bool Wrap>
+bool Chip8::DisplayBuffer::draw(unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height)
+{
+    ++m_generation;
+    if (m_planes == 1) {
+        return draw_plane<Width, Wrap>(m_rows[0], x, y, sprite, height);
+    }
+    bool collision = false;
+    for (int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (is_selected(plane)) {
+            collision |= draw_plane<Width, Wrap>(m_rows[plane], x, y, sprite, height);
+            sprite += Width / 8 * height;
+        }
     }
+    return collision;
+}
+
+template<unsigned int Width, bool Wrap>
+bool Chip8::DisplayBuffer::draw_plane(Plane& rows, unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height)
+{
+    uint64_t collision = 0;
+    if (!m_hires) {
+        for (unsigned int row = 0; row < height; ++row) {
+            unsigned int target = y + row;
+            if (target >= DISPLAY_HEIGHT) {
+                if constexpr (!Wrap) {
+                    break;
+                }
+                target -= DISPLAY_HEIGHT;
+            }
+            uint64_t bits = sprite_row<Width>(sprite, row);
+            uint64_t pattern = Wrap ? std::rotr(bits, static_cast<int>(x)) : bits >> x;
+            collision |= rows[target][0] & pattern;
+            rows[target][0] ^= pattern;
+        }
+        return collision != 0;
+    }
+
+    for (unsigned int row = 0; row < height; ++row) {
+        unsigned int target = y + row;
+        if (target >= HIRES_HEIGHT) {
+            if constexpr (!Wrap) {
+                break;
+            }
+            target -= HIRES_HEIGHT;
+        }
+        // the sprite is at most 16 wide, only a start in the right half
+        // can run over the edge
+        uint64_t bits = sprite_row<Width>(sprite, row);
+        uint64_t left;
+        uint64_t right;
+        if (x == 0) {
+            left = bits;
+            right = 0;
+        } else if (x < 64) {
+            left = bits >> x;
+            right = bits << (64 - x);
+        } else if (x == 64) {
+            left = 0;
+            right = bits;
+        } else {
+            left = Wrap ? bits << (128 - x) : 0;
+            right = bits >> (x - 64);
+        }
+        collision |= (rows[target][0] & left) | (rows[target][1] & right);
+        rows[target][0] ^= left;
+        rows[target][1] ^= right;
+    }
+    return collision != 0;
+}
+
+template bool Chip8::DisplayBuffer::draw_sprite<false>(unsigned int, unsigned int, const uint8_t*, unsigned int);
+template bool Chip8::DisplayBuffer::draw_sprite<true>(unsigned int, unsigned int, const uint8_t*, unsigned int);
+template bool Chip8::DisplayBuffer::draw_large_sprite<false>(unsigned int, unsigned int, const uint8_t*);
+template bool Chip8::DisplayBuffer::draw_large_sprite<true>(unsigned int, unsigned int, const uint8_t*);
+
+/**
+ * The scroll instructions move whole rows and words of the selected
+ * planes, amounts are in pixels of the current mode.
+ */
+void Chip8::DisplayBuffer::scroll_down(unsigned int rows)
+{
+    unsigned int height = get_mode_height();
+    rows = rows < height ? rows : height;
+    for (int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (is_selected(plane)) {
+            memmove(m_rows[plane][rows], m_rows[plane][0], (height - rows) * sizeof(m_rows[plane][0]));
+            memset(m_rows[plane][0], 0, rows * sizeof(m_rows[plane][0]));
+        }
+    }
+    ++m_generation;
+}
+
+void Chip8::DisplayBuffer::scroll_up(unsigned int rows)
+{
+    unsigned int height = get_mode_height();
+    rows = rows < height ? rows : height;
+    for (int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (is_selected(plane)) {
+            memmove(m_rows[plane][0], m_rows[plane][rows], (height - rows) * sizeof(m_rows[plane][0]));
+            memset(m_rows[plane][height - rows], 0, rows * sizeof(m_rows[plane][0]));
+        }
+    }
+    ++m_generation;
+}
+
+void Chip8::DisplayBuffer::scroll_left(unsigned int pixels)
+{
+    for (int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!is_selected(plane)) {
+            continue;
+        }
+        if (!m_hires) {
+            for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+                m_rows[plane][y][0] <<= pixels;
+            }
+        } else {
+            for (auto& row : m_rows[plane]) {
+                row[0] = (row[0] << pixels) | (row[1] >> (64 - pixels));
+                row[1] <<= pixels;
+            }
+        }
+    }
+    ++m_generation;
+}
+
+void Chip8::DisplayBuffer::scroll_right(unsigned int pixels)
+{
+    for (int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!is_selected(plane)) {
+            continue;
+        }
+        if (!m_hires) {
+            for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+                m_rows[plane][y][0] >>= pixels;
+            }
+        } else {
+            for (auto& row : m_rows[plane]) {
+                row[1] = (row[1] >> pixels) | (row[0] << (64 - pixels));
+                row[0] >>= pixels;
+            }
+        }
+    }
+    ++m_generation;
 }
 
 void Chip8::DisplayBuffer::clear()
 {
-    memset(m_display_data, 0, sizeof(m_display_data));
+    for (int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (is_selected(plane)) {
+            memset(m_rows[plane], 0, sizeof(m_rows[plane]));
+        }
+    }
+    ++m_generation;
 }
 
 void Chip8::DisplayBuffer::dump()
 {
-    const size_t ROW_SIZE = 1 << 6;
-    for (size_t i = 0; i < 32 * 64; i++) {
-        if (i % ROW_SIZE == 0) {
-            std::cout << '\n'
-                      << std::flush;
+    for (int y = 0; y < static_cast<int>(get_mode_height()); y++) {
+        std::cout << '\n'
+                  << std::flush;
+        for (int word = 0; word < (m_hires ? ROW_WORDS : 1); word++) {
+            std::cout << Common::int_to_hex(m_rows[0][y][word]) << " ";
+        }
+    }
+}
+
+/**
+ * Switching between 00FE and 00FF clears every plane.
+ */
+void Chip8::DisplayBuffer::set_hires(bool enabled)
+{
+    m_hires = enabled;
+    memset(m_rows, 0, sizeof(m_rows));
+    ++m_generation;
+}
+
+bool Chip8::DisplayBuffer::is_hires() const
+{
+    return m_hires;
+}
+
+unsigned int Chip8::DisplayBuffer::get_mode_width() const
+{
+    return m_hires ? HIRES_WIDTH : DISPLAY_WIDTH;
+}
+
+unsigned int Chip8::DisplayBuffer::get_mode_height() const
+{
+    return m_hires ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+}
+
+/**
+ * Fn01, planes is a mask with a bit per plane. None at all is allowed
+ * and makes drawing and clearing do nothing.
+ */
+void Chip8::DisplayBuffer::select_planes(unsigned int planes)
+{
+    m_planes = planes & ((1u << PLANE_COUNT) - 1);
+}
+
+unsigned int Chip8::DisplayBuffer::get_planes() const
+{
+    return m_planes;
+}
+
+unsigned int Chip8::DisplayBuffer::get_plane_count() const
+{
+    return (m_planes & 1u) + (m_planes >> 1u);
+}
+
+bool Chip8::DisplayBuffer::is_selected(int plane) const
+{
+    return (m_planes >> plane) & 1u;
+}
+
+/**
+ * Always fills a get_width() x get_height() frame, low resolution pixels
+ * come out as 2x2 blocks.
+ */
+void Chip8::DisplayBuffer::expand_to_rgba(uint32_t* pixels) const
+{
+    static constexpr uint32_t palette[4] = { PIXEL_OFF, PIXEL_ON, PIXEL_PLANE_2, PIXEL_BOTH };
+    if (m_hires) {
+        for (int y = 0; y < HIRES_HEIGHT; y++) {
+            for (int x = 0; x < HIRES_WIDTH; x++) {
+                uint64_t mask = pixel_mask(x % 64);
+                unsigned int colour = ((m_rows[0][y][x / 64] & mask) ? 1 : 0) | ((m_rows[1][y][x / 64] & mask) ? 2 : 0);
+                pixels[y * HIRES_WIDTH + x] = palette[colour];
+            }
         }
-        std::cout << Common::int_to_hex((int)m_display_data[i]) << " ";
+        return;
+    }
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        uint64_t first = m_rows[0][y][0];
+        uint64_t second = m_rows[1][y][0];
+        uint32_t* line = pixels + 2 * y * HIRES_WIDTH;
+        for (int x = 0; x < DISPLAY_WIDTH; x++) {
+            unsigned int colour = ((first & pixel_mask(x)) ? 1 : 0) | ((second & pixel_mask(x)) ? 2 : 0);
+            uint32_t pixel = palette[colour];
+            line[2 * x] = pixel;
+            line[2 * x + 1] = pixel;
+        }
+        memcpy(line + HIRES_WIDTH, line, HIRES_WIDTH * sizeof(uint32_t));
     }
 }
 
 int Chip8::DisplayBuffer::get_width()
 {
-    return DISPLAY_WIDTH;
+    return HIRES_WIDTH;
 }
 
 int Chip8::DisplayBuffer::get_height()
 {
-    return DISPLAY_HEIGHT;
+    return HIRES_HEIGHT;
 }
 
-uint32_t* Chip8::DisplayBuffer::get_display_data()
+/**
+ * PLANE_COUNT * WORD_COUNT words, plane by plane and row by row.
+ */
+const uint64_t* Chip8::DisplayBuffer::get_rows() const
 {
-    return m_display_data;
+    return m_rows[0][0];
 }
 
-void Chip8::DisplayBuffer::set_pixel(int x, int y, int value)
+void Chip8::DisplayBuffer::load_rows(const uint64_t* rows, bool hires, unsigned int planes)
 {
-    int position = y * 32 + x;
-    unsigned short current_value = m_display_data[position];
-    unsigned short new_value = value;
+    memcpy(m_rows, rows, sizeof(m_rows));
+    m_hires = hires;
+    select_planes(planes);
+    ++m_generation;
+}
+
+uint64_t Chip8::DisplayBuffer::get_generation() const
+{
+    return m_generation;
+}
+
+/**
+ * FNV-1a over the packed rows of the current mode, stable across runs
+ * and platforms so it can be used to compare the final screen of two
+ * runs. The second plane only goes in once something is drawn on it,
+ * single plane screens hash the same as they always did.
+ */
+uint64_t Chip8::DisplayBuffer::hash() const
+{
+    int words = m_hires ? ROW_WORDS : 1;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    bool second_plane = false;
+    for (int plane = 0; plane < PLANE_COUNT && (plane == 0 || second_plane); plane++) {
+        for (int y = 0; y < static_cast<int>(get_mode_height()); y++) {
+            for (int word = 0; word < words; word++) {
+                second_plane |= m_rows[1][y][word] != 0;
+                for (int byte = 7; byte >= 0; byte--) {
+                    hash ^= (m_rows[plane][y][word] >> (byte * 8)) & 0xFFu;
+                    hash *= 0x100000001b3ull;
+                }
+            }
+        }
+    }
+    return hash;
+}
 
-    unsigned short ored = current_value | new_value;
-    unsigned short neg_ored = ~current_value | ~new_value;
-    m_display_data[position] = ored & neg_ored;
+void Chip8::DisplayBuffer::set_pixel(int x, int y, int value)
+{
+    if (value) {
+        m_rows[0][y][0] ^= pixel_mask(x);
+        ++m_generation;
+    }
 }
@@ -23,21 +23,77 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
+#include <Types.h>
 #include <cstdint>
 namespace Chip8 {
-    class DisplayBuffer final {
+    /**
+     * The display is stored as one bit per pixel, two 64 bit words per
+     * row with the most significant bit being the leftmost pixel. The
+     * 64x32 low resolution mode only uses the first word of the first 32
+     * rows, the SUPER-CHIP 128x64 high resolution mode all of them.
+     * XO-CHIP adds a second plane of the same layout, drawing, clearing
+     * and scrolling only touch the planes selected with Fn01 and the two
+     * bits of a pixel pick one of four colours.
+     */
+    class alignas(Common::CACHE_LINE_SIZE) DisplayBuffer final {
     public:
+        static constexpr int DISPLAY_WIDTH = 64;
+        static constexpr int DISPLAY_HEIGHT = 32;
+        static constexpr int HIRES_WIDTH = 128;
+        static constexpr int HIRES_HEIGHT = 64;
+        static constexpr int ROW_WORDS = HIRES_WIDTH / 64;
+        static constexpr int WORD_COUNT = HIRES_HEIGHT * ROW_WORDS;
+        static constexpr int PLANE_COUNT = 2;
+
         void apply_display_data(const unsigned short new_display_data[32 * 64]);
         void set_pixel(int x, int y, int value);
+        // 8 pixels wide and height rows high, 16x16 with two bytes per row,
+        // one such sprite after the other for each selected plane
+        template<bool Wrap>
+        bool draw_sprite(unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height);
+        template<bool Wrap>
+        bool draw_large_sprite(unsigned int x, unsigned int y, const uint8_t* sprite);
+        void scroll_down(unsigned int rows);
+        void scroll_up(unsigned int rows);
+        void scroll_left(unsigned int pixels);
+        void scroll_right(unsigned int pixels);
         void clear();
         void dump();
+        void set_hires(bool enabled);
+        bool is_hires() const;
+        unsigned int get_mode_width() const;
+        unsigned int get_mode_height() const;
+        void select_planes(unsigned int planes);
+        unsigned int get_planes() const;
+        unsigned int get_plane_count() const;
+        void expand_to_rgba(uint32_t* pixels) const;
         static int get_width();
         static int get_height();
-        uint32_t* get_display_data();
+        const uint64_t* get_rows() const;
+        void load_rows(const uint64_t* rows, bool hires, unsigned int planes);
+        uint64_t get_generation() const;
+        uint64_t hash() const;
+
+        static constexpr uint32_t PIXEL_ON = 0xFFFFFFFF;
+        static constexpr uint32_t PIXEL_OFF = 0x00000000;
+        // pixels set in the second XO-CHIP plane only and in both
+        static constexpr uint32_t PIXEL_PLANE_2 = 0xAAAAAAFF;
+        static constexpr uint32_t PIXEL_BOTH = 0x555555FF;
 
     private:
-        const static int DISPLAY_WIDTH = 64;
-        const static int DISPLAY_HEIGHT = 32;
-        uint32_t m_display_data[DISPLAY_WIDTH * DISPLAY_WIDTH]{};
+        using Plane = uint64_t[HIRES_HEIGHT][ROW_WORDS];
+
+        template<unsigned int Width, bool Wrap>
+        bool draw(unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height);
+        template<unsigned int Width, bool Wrap>
+        bool draw_plane(Plane& rows, unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height);
+        bool is_selected(int plane) const;
+
+        uint64_t m_rows[PLANE_COUNT][HIRES_HEIGHT][ROW_WORDS]{};
+        bool m_hires = false;
+        // bit 0 selects the first plane, bit 1 the second
+        unsigned int m_planes = 1;
+        // bumped on every change, lets the frontend skip unchanged frames
+        uint64_t m_generation = 0;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,121 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Headless.h"
+#include "Audio.h"
+#include "InputLog.h"
+#include "Machine.h"
+#include <Print.h>
+#include <chrono>
+#include <iostream>
+
+/**
+ * Stops at every frame boundary to render the sound of that frame, a
+ * frame cut short by the budget isn't rendered.
+ */
+static Chip8::RunResult run_with_audio(Chip8::InputReplay& replay, Chip8::Cpu& cpu, Common::u64 budget, std::vector<int16_t>& samples)
+{
+    Chip8::AudioSynth synth;
+    unsigned int frame_samples = synth.get_samples_per_frame();
+    Common::u64 executed = 0;
+    while (true) {
+        Chip8::RunResult result = replay.run_until(cpu, static_cast<unsigned int>(Chip8::StopReason::FrameBoundary), budget - executed);
+        executed += result.cycles;
+        if (result.reason != Chip8::StopReason::FrameBoundary) {
+            return { result.reason, executed };
+        }
+        samples.resize(samples.size() + frame_samples);
+        synth.render(Chip8::audio_frame_of(cpu), samples.data() + samples.size() - frame_samples, frame_samples);
+        if (executed == budget) {
+            return { Chip8::StopReason::BudgetExhausted, executed };
+        }
+    }
+}
+
+int Chip8::run_headless(const std::string& source_file, const HeadlessOptions& options)
+{
+    Machine machine;
+    if (!machine.load_program(source_file)) {
+        Common::err("Failed to open ", source_file);
+        return Common::EXIT_FAIL;
+    }
+    Cpu& cpu = machine.get_cpu();
+    cpu.set_core(options.core);
+    cpu.set_fusion(options.fusion);
+    cpu.set_quirks(options.quirks);
+    cpu.set_cycles_per_frame(options.cycles_per_frame);
+    cpu.set_seed(options.seed);
+    InputLog input_log;
+    if (!options.replay_file.empty()) {
+        if (!input_log.load(options.replay_file)) {
+            Common::err("Failed to load input from ", options.replay_file);
+            return Common::EXIT_FAIL;
+        }
+        cpu.set_quirks(input_log.get_quirks());
+        cpu.set_cycles_per_frame(input_log.get_cycles_per_frame());
+        cpu.set_seed(input_log.get_seed());
+    }
+    if (!options.recompiled_file.empty() && !cpu.load_recompiled(options.recompiled_file)) {
+        return Common::EXIT_FAIL;
+    }
+    if (!options.load_state_file.empty() && !machine.load_state_file(options.load_state_file)) {
+        Common::err("Failed to load state from ", options.load_state_file);
+        return Common::EXIT_FAIL;
+    }
+    InputReplay replay(input_log);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int16_t> samples;
+    RunResult result = options.wav_file.empty() ? replay.run_until(cpu, 0, options.cycles) : run_with_audio(replay, cpu, options.cycles, samples);
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double per_second = seconds > 0 ? static_cast<double>(result.cycles) / seconds : 0;
+    Common::msg("stop reason: ", to_string(result.reason));
+    Common::msg("instructions: ", result.cycles);
+    Common::msg("frames: ", cpu.get_frame_count());
+    Common::msg("skipped idle instructions: ", cpu.get_idle_cycles());
+    Common::msg("seconds: ", seconds);
+    Common::msg("instructions/sec: ", static_cast<Common::u64>(per_second));
+    Common::msg("framebuffer hash: ", Common::int_to_hex(machine.get_display().hash()));
+    if (cpu.get_core() == CpuCore::Jit) {
+        JitStats jit = cpu.get_jit_stats();
+        Common::msg("jit: ", jit.blocks_compiled, " blocks compiled, ", jit.blocks_invalidated, " invalidated, ",
+            jit.flushes, " flushes, ", jit.interpreted, " instructions interpreted");
+    }
+    if (!options.recompiled_file.empty()) {
+        Common::msg("recompiled: ", cpu.is_recompiled_active() ? "active" : "overwritten, finished on the interpreter");
+    }
+#ifdef CHIP8_PROFILER
+    cpu.get_profiler().write_report(std::cout);
+#endif
+    if (!options.wav_file.empty() && !write_wav(options.wav_file, samples)) {
+        Common::err("Failed to write audio to ", options.wav_file);
+        return Common::EXIT_FAIL;
+    }
+    if (!options.save_state_file.empty() && !machine.save_state_file(options.save_state_file)) {
+        Common::err("Failed to save state to ", options.save_state_file);
+        return Common::EXIT_FAIL;
+    }
+    return result.reason == StopReason::BudgetExhausted ? Common::EXIT_SUCC : Common::EXIT_FAIL;
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "Cpu.h"
+#include <Types.h>
+#include <string>
+
+namespace Chip8 {
+    struct HeadlessOptions {
+        Common::u64 cycles;
+        CpuCore core;
+        bool fusion;
+        QuirkProfile quirks;
+        unsigned int cycles_per_frame;
+        Common::u64 seed;
+        std::string load_state_file;
+        std::string save_state_file;
+        std::string replay_file;
+        std::string recompiled_file;
+        std::string wav_file;
+    };
+
+    /**
+     * Runs source_file for the given number of instructions as fast as
+     * possible without opening a window and prints throughput and a hash
+     * of the final framebuffer. With a replay file the recorded input is
+     * fed back, and its seed, speed and quirks take precedence over the
+     * options. With a WAV file the sound of every emulated frame is
+     * rendered into it, still as fast as the program runs.
+     */
+    int run_headless(const std::string& source_file, const HeadlessOptions& options);
+}
@@ -0,0 +1,190 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "InputLog.h"
+#include "ByteStream.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+static const uint8_t INPUT_MAGIC[4] = { 'C', '8', 'I', 'N' };
+
+/**
+ * Appends an event if keys differs from what the log currently ends with.
+ * Cycles have to be recorded in non decreasing order.
+ */
+void Chip8::InputLog::record(Common::u64 cycle, uint16_t keys)
+{
+    uint16_t current = m_events.empty() ? 0 : m_events.back().keys;
+    if (keys != current) {
+        m_events.push_back({ cycle, keys });
+    }
+}
+
+/**
+ * Drops every event at or after cycle, used when the session is rewound.
+ */
+void Chip8::InputLog::truncate(Common::u64 cycle)
+{
+    auto first = std::lower_bound(m_events.begin(), m_events.end(), cycle,
+        [](const InputEvent& event, Common::u64 value) { return event.cycle < value; });
+    m_events.erase(first, m_events.end());
+}
+
+const std::vector<Chip8::InputEvent>& Chip8::InputLog::get_events() const
+{
+    return m_events;
+}
+
+void Chip8::InputLog::set_seed(Common::u64 seed)
+{
+    m_seed = seed;
+}
+
+Common::u64 Chip8::InputLog::get_seed() const
+{
+    return m_seed;
+}
+
+void Chip8::InputLog::set_cycles_per_frame(unsigned int cycles)
+{
+    m_cycles_per_frame = cycles;
+}
+
+unsigned int Chip8::InputLog::get_cycles_per_frame() const
+{
+    return m_cycles_per_frame;
+}
+
+void Chip8::InputLog::set_quirks(QuirkProfile profile)
+{
+    m_quirks = profile;
+}
+
+Chip8::QuirkProfile Chip8::InputLog::get_quirks() const
+{
+    return m_quirks;
+}
+
+bool Chip8::InputLog::save(const std::string& file) const
+{
+    std::vector<uint8_t> blob;
+    Writer writer(blob);
+    writer.put_bytes(INPUT_MAGIC, sizeof(INPUT_MAGIC));
+    writer.put(VERSION);
+    writer.put(m_seed);
+    writer.put(static_cast<uint32_t>(m_cycles_per_frame));
+    writer.put(static_cast<uint8_t>(m_quirks));
+    writer.put(static_cast<uint32_t>(m_events.size()));
+    for (const InputEvent& event : m_events) {
+        writer.put(event.cycle);
+        writer.put(event.keys);
+    }
+    std::ofstream out(file, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(blob.data()), blob.size());
+    return out.good();
+}
+
+bool Chip8::InputLog::load(const std::string& file)
+{
+    std::ifstream in(file, std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::vector<uint8_t> blob { std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+    Reader reader(blob);
+    uint8_t magic[sizeof(INPUT_MAGIC)];
+    reader.get_bytes(magic, sizeof(magic));
+    if (memcmp(magic, INPUT_MAGIC, sizeof(magic)) != 0 || reader.get<uint16_t>() != VERSION) {
+        return false;
+    }
+    // nothing is taken over until the whole file checked out
+    auto seed = reader.get<Common::u64>();
+    auto cycles_per_frame = reader.get<uint32_t>();
+    auto quirks = reader.get<uint8_t>();
+    if (quirks > static_cast<uint8_t>(QuirkProfile::XoChip)) {
+        return false;
+    }
+    auto count = reader.get<uint32_t>();
+    std::vector<InputEvent> events;
+    for (uint32_t i = 0; i < count && reader.ok(); i++) {
+        InputEvent event {};
+        event.cycle = reader.get<Common::u64>();
+        event.keys = reader.get<uint16_t>();
+        if (!events.empty() && event.cycle < events.back().cycle) {
+            return false;
+        }
+        events.push_back(event);
+    }
+    if (!reader.ok() || cycles_per_frame == 0) {
+        return false;
+    }
+    m_seed = seed;
+    m_cycles_per_frame = cycles_per_frame;
+    m_quirks = static_cast<QuirkProfile>(quirks);
+    m_events = std::move(events);
+    return true;
+}
+
+Chip8::InputReplay::InputReplay(const InputLog& log)
+    : m_log(log)
+{
+}
+
+void Chip8::InputReplay::apply_due_events(Cpu& cpu)
+{
+    const auto& events = m_log.get_events();
+    while (m_next < events.size() && events[m_next].cycle <= cpu.get_cycle_count()) {
+        m_keys = events[m_next++].keys;
+    }
+    cpu.set_keypad_mask(m_keys);
+}
+
+/**
+ * Same contract as Cpu::run_until, but the keypad is driven by the log.
+ * Whatever the keypad held before is overwritten, so live input is
+ * ignored while replaying.
+ */
+Chip8::RunResult Chip8::InputReplay::run_until(Cpu& cpu, unsigned int events, Common::u64 budget)
+{
+    const auto& log_events = m_log.get_events();
+    Common::u64 executed = 0;
+    while (true) {
+        apply_due_events(cpu);
+        Common::u64 slice = budget - executed;
+        if (m_next < log_events.size()) {
+            slice = std::min(slice, log_events[m_next].cycle - cpu.get_cycle_count());
+        }
+        RunResult result = cpu.run_until(events, slice);
+        executed += result.cycles;
+        if (result.reason != StopReason::BudgetExhausted || executed == budget) {
+            return { result.reason, executed };
+        }
+    }
+}
+
+bool Chip8::InputReplay::is_finished() const
+{
+    return m_next == m_log.get_events().size();
+}
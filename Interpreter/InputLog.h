@@ -0,0 +1,91 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "Cpu.h"
+#include <Types.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Chip8 {
+    /**
+     * Keypad contents from cycle onwards, one bit per key.
+     */
+    struct InputEvent {
+        Common::u64 cycle;
+        uint16_t keys;
+    };
+
+    /**
+     * Recorded session input. Together with the seed, the instructions
+     * per frame and the quirk profile it was recorded with, replaying the
+     * log reproduces the session exactly, on any machine.
+     *
+     * File layout, little endian:
+     *
+     *   "C8IN" | u16 version | u64 seed | u32 cycles per frame | u8 quirks | u32 count | (u64 cycle, u16 keys) * count
+     */
+    class InputLog final {
+    public:
+        void record(Common::u64 cycle, uint16_t keys);
+        void truncate(Common::u64 cycle);
+        const std::vector<InputEvent>& get_events() const;
+        void set_seed(Common::u64 seed);
+        Common::u64 get_seed() const;
+        void set_cycles_per_frame(unsigned int cycles);
+        unsigned int get_cycles_per_frame() const;
+        void set_quirks(QuirkProfile profile);
+        QuirkProfile get_quirks() const;
+
+        bool save(const std::string& file) const;
+        bool load(const std::string& file);
+
+        static constexpr uint16_t VERSION = 2;
+
+    private:
+        std::vector<InputEvent> m_events;
+        Common::u64 m_seed = DEFAULT_SEED;
+        unsigned int m_cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+        QuirkProfile m_quirks = QuirkProfile::Modern;
+    };
+
+    /**
+     * Feeds an InputLog back into a Cpu. run_until never runs past the next
+     * event, so neither idle loop skipping nor large budgets can make an
+     * event land on a different cycle than it was recorded on.
+     */
+    class InputReplay final {
+    public:
+        explicit InputReplay(const InputLog& log);
+        RunResult run_until(Cpu& cpu, unsigned int events, Common::u64 budget);
+        bool is_finished() const;
+
+    private:
+        void apply_due_events(Cpu& cpu);
+
+        const InputLog& m_log;
+        size_t m_next = 0;
+        uint16_t m_keys = 0;
+    };
+}
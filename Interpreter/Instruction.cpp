@@ -0,0 +1,390 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Instruction.h"
+#include "Quirks.h"
+
+Chip8::Instruction Chip8::decode_fields(uint16_t opcode)
+{
+    return {
+        .operation = Operation::None,
+        .x = static_cast<uint8_t>((opcode & 0x0F00u) >> 8u),
+        .y = static_cast<uint8_t>((opcode & 0x00F0u) >> 4u),
+        .n = static_cast<uint8_t>(opcode & 0x000Fu),
+        .kk = static_cast<uint8_t>(opcode & 0x00FFu),
+        .fusion = Fusion::None,
+        .nnn = static_cast<uint16_t>(opcode & 0x0FFFu)
+    };
+}
+
+/**
+ * Maps an opcode onto the same handler the dispatch tables in Cpu
+ * would pick, including the loose matching on the low nibble / byte.
+ */
+static Chip8::Operation decode_operation(uint16_t opcode)
+{
+    using Chip8::Operation;
+    switch ((opcode & 0xF000u) >> 12u) {
+    case 0x0:
+        // the SUPER-CHIP and XO-CHIP additions first, they would match 00E0 and 00EE
+        switch (opcode & 0x00FFu) {
+        case 0xFB:
+            return Operation::Op00FB;
+        case 0xFC:
+            return Operation::Op00FC;
+        case 0xFE:
+            return Operation::Op00FE;
+        case 0xFF:
+            return Operation::Op00FF;
+        default:
+            break;
+        }
+        if ((opcode & 0x00F0u) == 0x00C0u) {
+            return Operation::Op00Cn;
+        }
+        if ((opcode & 0x00F0u) == 0x00D0u) {
+            return Operation::Op00Dn;
+        }
+        switch (opcode & 0x000Fu) {
+        case 0x0:
+            return Operation::Op00E0;
+        case 0xE:
+            return Operation::Op00EE;
+        default:
+            return Operation::None;
+        }
+    case 0x1:
+        return Operation::Op1nnn;
+    case 0x2:
+        return Operation::Op2nnn;
+    case 0x3:
+        return Operation::Op3xkk;
+    case 0x4:
+        return Operation::Op4xkk;
+    case 0x5:
+        switch (opcode & 0x000Fu) {
+        case 0x2:
+            return Operation::Op5xy2;
+        case 0x3:
+            return Operation::Op5xy3;
+        default:
+            return Operation::Op5xy0;
+        }
+    case 0x6:
+        return Operation::Op6xkk;
+    case 0x7:
+        return Operation::Op7xkk;
+    case 0x8:
+        switch (opcode & 0x000Fu) {
+        case 0x0:
+            return Operation::Op8xy0;
+        case 0x1:
+            return Operation::Op8xy1;
+        case 0x2:
+            return Operation::Op8xy2;
+        case 0x3:
+            return Operation::Op8xy3;
+        case 0x4:
+            return Operation::Op8xy4;
+        case 0x5:
+            return Operation::Op8xy5;
+        case 0x6:
+            return Operation::Op8xy6;
+        case 0x7:
+            return Operation::Op8xy7;
+        case 0xE:
+            return Operation::Op8xyE;
+        default:
+            return Operation::None;
+        }
+    case 0x9:
+        return Operation::Op9xy0;
+    case 0xA:
+        return Operation::OpAnnn;
+    case 0xB:
+        return Operation::OpBnnn;
+    case 0xC:
+        return Operation::OpCxkk;
+    case 0xD:
+        return Operation::OpDxyn;
+    case 0xE:
+        switch (opcode & 0x000Fu) {
+        case 0x1:
+            return Operation::OpExA1;
+        case 0xE:
+            return Operation::OpEx9E;
+        default:
+            return Operation::None;
+        }
+    case 0xF:
+        switch (opcode & 0x00FFu) {
+        case 0x00:
+            return Operation::OpF000;
+        case 0x01:
+            return Operation::OpFn01;
+        case 0x02:
+            return Operation::OpF002;
+        case 0x07:
+            return Operation::OpFx07;
+        case 0x0A:
+            return Operation::OpFx0A;
+        case 0x15:
+            return Operation::OpFx15;
+        case 0x18:
+            return Operation::OpFx18;
+        case 0x1E:
+            return Operation::OpFx1E;
+        case 0x29:
+            return Operation::OpFx29;
+        case 0x30:
+            return Operation::OpFx30;
+        case 0x33:
+            return Operation::OpFx33;
+        case 0x3A:
+            return Operation::OpFx3A;
+        case 0x55:
+            return Operation::OpFx55;
+        case 0x65:
+            return Operation::OpFx65;
+        default:
+            return Operation::None;
+        }
+    default:
+        return Operation::None;
+    }
+}
+
+Chip8::Instruction Chip8::decode(uint16_t opcode)
+{
+    Instruction instruction = decode_fields(opcode);
+    instruction.operation = decode_operation(opcode);
+    return instruction;
+}
+
+/**
+ * The operation a profile runs for instruction. The SUPER-CHIP and
+ * XO-CHIP opcodes only exist in their profiles, elsewhere they do what
+ * the original dispatch tables made of them by matching the low nibble:
+ * 00x0 clears the screen, 00xE returns, 5xy2 and 5xy3 compare like 5xy0
+ * and the rest is invalid. The handlers in Cpu fall back the same way.
+ */
+Chip8::Operation Chip8::resolve_operation(const Instruction& instruction, const QuirkFlags& quirks)
+{
+    auto low_nibble = [&instruction] {
+        switch (instruction.n) {
+        case 0x0:
+            return Operation::Op00E0;
+        case 0xE:
+            return Operation::Op00EE;
+        default:
+            return Operation::None;
+        }
+    };
+    switch (instruction.operation) {
+    case Operation::Op00Cn:
+    case Operation::Op00FB:
+    case Operation::Op00FC:
+    case Operation::Op00FE:
+    case Operation::Op00FF:
+        return quirks.large_sprites ? instruction.operation : low_nibble();
+    case Operation::Op00Dn:
+        return quirks.xo_chip_opcodes ? instruction.operation : low_nibble();
+    case Operation::Op5xy2:
+    case Operation::Op5xy3:
+        return quirks.xo_chip_opcodes ? instruction.operation : Operation::Op5xy0;
+    case Operation::OpFx30:
+        return quirks.large_sprites ? instruction.operation : Operation::None;
+    case Operation::OpF000:
+    case Operation::OpFn01:
+    case Operation::OpF002:
+    case Operation::OpFx3A:
+        return quirks.xo_chip_opcodes ? instruction.operation : Operation::None;
+    default:
+        return instruction.operation;
+    }
+}
+
+Chip8::Fusion Chip8::fuse(Operation first, Operation second)
+{
+    switch (first) {
+    case Operation::OpAnnn:
+        return second == Operation::OpDxyn ? Fusion::OpAnnnDxyn : Fusion::None;
+    case Operation::OpFx07:
+        return second == Operation::Op3xkk ? Fusion::OpFx073xkk : Fusion::None;
+    case Operation::OpFx29:
+        return second == Operation::OpDxyn ? Fusion::OpFx29Dxyn : Fusion::None;
+    case Operation::Op6xkk:
+        switch (second) {
+        case Operation::Op6xkk:
+            return Fusion::Op6xkk6xkk;
+        case Operation::Op8xy2:
+            return Fusion::Op6xkk8xy2;
+        case Operation::OpExA1:
+            return Fusion::Op6xkkExA1;
+        default:
+            return Fusion::None;
+        }
+    case Operation::Op3xkk:
+        return second == Operation::Op1nnn ? Fusion::Op3xkk1nnn : Fusion::None;
+    case Operation::Op4xkk:
+        return second == Operation::Op1nnn ? Fusion::Op4xkk1nnn : Fusion::None;
+    case Operation::Op7xkk:
+        return second == Operation::Op3xkk ? Fusion::Op7xkk3xkk : Fusion::None;
+    default:
+        return Fusion::None;
+    }
+}
+
+const char* Chip8::to_string(Operation operation)
+{
+    switch (operation) {
+    case Operation::None:
+        return "invalid";
+    case Operation::Op00E0:
+        return "00E0";
+    case Operation::Op00EE:
+        return "00EE";
+    case Operation::Op00Cn:
+        return "00Cn";
+    case Operation::Op00Dn:
+        return "00Dn";
+    case Operation::Op00FB:
+        return "00FB";
+    case Operation::Op00FC:
+        return "00FC";
+    case Operation::Op00FE:
+        return "00FE";
+    case Operation::Op00FF:
+        return "00FF";
+    case Operation::Op1nnn:
+        return "1nnn";
+    case Operation::Op2nnn:
+        return "2nnn";
+    case Operation::Op3xkk:
+        return "3xkk";
+    case Operation::Op4xkk:
+        return "4xkk";
+    case Operation::Op5xy0:
+        return "5xy0";
+    case Operation::Op5xy2:
+        return "5xy2";
+    case Operation::Op5xy3:
+        return "5xy3";
+    case Operation::Op6xkk:
+        return "6xkk";
+    case Operation::Op7xkk:
+        return "7xkk";
+    case Operation::Op8xy0:
+        return "8xy0";
+    case Operation::Op8xy1:
+        return "8xy1";
+    case Operation::Op8xy2:
+        return "8xy2";
+    case Operation::Op8xy3:
+        return "8xy3";
+    case Operation::Op8xy4:
+        return "8xy4";
+    case Operation::Op8xy5:
+        return "8xy5";
+    case Operation::Op8xy6:
+        return "8xy6";
+    case Operation::Op8xy7:
+        return "8xy7";
+    case Operation::Op8xyE:
+        return "8xyE";
+    case Operation::Op9xy0:
+        return "9xy0";
+    case Operation::OpAnnn:
+        return "Annn";
+    case Operation::OpBnnn:
+        return "Bnnn";
+    case Operation::OpCxkk:
+        return "Cxkk";
+    case Operation::OpDxyn:
+        return "Dxyn";
+    case Operation::OpEx9E:
+        return "Ex9E";
+    case Operation::OpExA1:
+        return "ExA1";
+    case Operation::OpF000:
+        return "F000";
+    case Operation::OpFn01:
+        return "Fn01";
+    case Operation::OpF002:
+        return "F002";
+    case Operation::OpFx07:
+        return "Fx07";
+    case Operation::OpFx0A:
+        return "Fx0A";
+    case Operation::OpFx15:
+        return "Fx15";
+    case Operation::OpFx18:
+        return "Fx18";
+    case Operation::OpFx1E:
+        return "Fx1E";
+    case Operation::OpFx29:
+        return "Fx29";
+    case Operation::OpFx30:
+        return "Fx30";
+    case Operation::OpFx33:
+        return "Fx33";
+    case Operation::OpFx3A:
+        return "Fx3A";
+    case Operation::OpFx55:
+        return "Fx55";
+    case Operation::OpFx65:
+        return "Fx65";
+    case Operation::Count:
+        break;
+    }
+    return "unknown";
+}
+
+const char* Chip8::to_string(Fusion fusion)
+{
+    switch (fusion) {
+    case Fusion::None:
+        return "none";
+    case Fusion::OpAnnnDxyn:
+        return "Annn+Dxyn";
+    case Fusion::OpFx29Dxyn:
+        return "Fx29+Dxyn";
+    case Fusion::Op6xkk6xkk:
+        return "6xkk+6xkk";
+    case Fusion::Op6xkk8xy2:
+        return "6xkk+8xy2";
+    case Fusion::Op6xkkExA1:
+        return "6xkk+ExA1";
+    case Fusion::Op3xkk1nnn:
+        return "3xkk+1nnn";
+    case Fusion::Op4xkk1nnn:
+        return "4xkk+1nnn";
+    case Fusion::Op7xkk3xkk:
+        return "7xkk+3xkk";
+    case Fusion::OpFx073xkk:
+        return "Fx07+3xkk";
+    case Fusion::Count:
+        break;
+    }
+    return "unknown";
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include <cstdint>
+
+namespace Chip8 {
+    enum class Operation : uint8_t {
+        None,
+        Op00E0,
+        Op00EE,
+        Op00Cn,
+        Op00Dn,
+        Op00FB,
+        Op00FC,
+        Op00FE,
+        Op00FF,
+        Op1nnn,
+        Op2nnn,
+        Op3xkk,
+        Op4xkk,
+        Op5xy0,
+        Op5xy2,
+        Op5xy3,
+        Op6xkk,
+        Op7xkk,
+        Op8xy0,
+        Op8xy1,
+        Op8xy2,
+        Op8xy3,
+        Op8xy4,
+        Op8xy5,
+        Op8xy6,
+        Op8xy7,
+        Op8xyE,
+        Op9xy0,
+        OpAnnn,
+        OpBnnn,
+        OpCxkk,
+        OpDxyn,
+        OpEx9E,
+        OpExA1,
+        OpF000,
+        OpFn01,
+        OpF002,
+        OpFx07,
+        OpFx0A,
+        OpFx15,
+        OpFx18,
+        OpFx1E,
+        OpFx29,
+        OpFx30,
+        OpFx33,
+        OpFx3A,
+        OpFx55,
+        OpFx65,
+        Count
+    };
+
+    /**
+     * Pairs of instructions common enough in real programs to be run
+     * with a single dispatch, picked from the sequences the profiler
+     * reports. The first instruction of each pair never raises an event,
+     * so the pair can only stop after the second.
+     */
+    enum class Fusion : uint8_t {
+        None,
+        OpAnnnDxyn,
+        OpFx29Dxyn,
+        Op6xkk6xkk,
+        Op6xkk8xy2,
+        Op6xkkExA1,
+        Op3xkk1nnn,
+        Op4xkk1nnn,
+        Op7xkk3xkk,
+        OpFx073xkk,
+        Count
+    };
+
+    /**
+     * An opcode with all of its operand fields extracted, so the
+     * handlers don't have to mask and shift the raw opcode again.
+     * fusion is only filled in by the decode cache and names the pair
+     * this instruction forms with the one right behind it.
+     */
+    struct Instruction {
+        Operation operation;
+        uint8_t x;
+        uint8_t y;
+        uint8_t n;
+        uint8_t kk;
+        Fusion fusion;
+        uint16_t nnn;
+    };
+
+    struct QuirkFlags;
+
+    Instruction decode_fields(uint16_t opcode);
+    Instruction decode(uint16_t opcode);
+    Operation resolve_operation(const Instruction& instruction, const QuirkFlags& quirks);
+    Fusion fuse(Operation first, Operation second);
+    const char* to_string(Operation operation);
+    const char* to_string(Fusion fusion);
+}
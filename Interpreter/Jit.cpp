@@ -0,0 +1,685 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Jit.h"
+#include "Cpu.h"
+#include <algorithm>
+#include <cstring>
+#ifdef HAS_JIT
+#    include <sys/mman.h>
+#endif
+
+/**
+ * A translated block, the native code itself lives in the code buffer.
+ */
+struct Chip8::Jit::Block {
+    uint16_t start;
+    // first byte after the last translated instruction
+    uint16_t end;
+    const uint8_t* body;
+    // addresses this block provides the entry for
+    std::vector<uint16_t> entries;
+    // chain slots this block jumps through, per target address
+    std::vector<std::pair<uint16_t, uint64_t*>> exits;
+};
+
+#ifdef HAS_JIT
+namespace {
+    // condition codes for jcc
+    enum Condition : uint8_t {
+        Below = 0x2,
+        Equal = 0x4,
+        NotEqual = 0x5,
+        Above = 0x7,
+    };
+
+    /**
+     * Just enough of an x86-64 assembler for the code the Jit emits. The
+     * Cpu pointer is kept in rbx, so every Cpu field is [rbx + disp32],
+     * the remaining instruction budget is kept in r13.
+     */
+    class Emitter final {
+    public:
+        explicit Emitter(uint8_t* at)
+            : m_at(at)
+        {
+        }
+
+        uint8_t* position() const { return m_at; }
+
+        void bytes(std::initializer_list<uint8_t> values)
+        {
+            for (uint8_t value : values) {
+                *m_at++ = value;
+            }
+        }
+
+        template<typename T>
+        void value(T data)
+        {
+            memcpy(m_at, &data, sizeof(T));
+            m_at += sizeof(T);
+        }
+
+        // op with a [rbx + disp32] operand, modrm reg field given
+        void rbx_operand(std::initializer_list<uint8_t> opcode, uint8_t reg, int32_t displacement)
+        {
+            bytes(opcode);
+            bytes({ static_cast<uint8_t>(0x83u | (reg << 3u)) });
+            value(displacement);
+        }
+
+        void load_al(int32_t displacement) { rbx_operand({ 0x8A }, 0, displacement); }
+        void load_cl(int32_t displacement) { rbx_operand({ 0x8A }, 1, displacement); }
+        void store_al(int32_t displacement) { rbx_operand({ 0x88 }, 0, displacement); }
+        void store_dl(int32_t displacement) { rbx_operand({ 0x88 }, 2, displacement); }
+
+        void store_imm8(int32_t displacement, uint8_t immediate)
+        {
+            rbx_operand({ 0xC6 }, 0, displacement);
+            value(immediate);
+        }
+
+        void add_imm8(int32_t displacement, uint8_t immediate)
+        {
+            rbx_operand({ 0x80 }, 0, displacement);
+            value(immediate);
+        }
+
+        void compare_imm8(int32_t displacement, uint8_t immediate)
+        {
+            rbx_operand({ 0x80 }, 7, displacement);
+            value(immediate);
+        }
+
+        void compare_al(int32_t displacement) { rbx_operand({ 0x3A }, 0, displacement); }
+
+        void store_imm16(int32_t displacement, uint16_t immediate)
+        {
+            rbx_operand({ 0x66, 0xC7 }, 0, displacement);
+            value(immediate);
+        }
+
+        void load_zero_extended_eax(int32_t displacement) { rbx_operand({ 0x0F, 0xB6 }, 0, displacement); }
+        void add_ax(int32_t displacement) { rbx_operand({ 0x66, 0x01 }, 0, displacement); }
+        void store_ax(int32_t displacement) { rbx_operand({ 0x66, 0x89 }, 0, displacement); }
+        void load_eax(int32_t displacement) { rbx_operand({ 0x8B }, 0, displacement); }
+        void and_eax(int32_t displacement) { rbx_operand({ 0x23 }, 0, displacement); }
+
+        // rel32 jumps, the returned position is patched by bind
+        uint8_t* jump_if(Condition condition)
+        {
+            bytes({ 0x0F, static_cast<uint8_t>(0x80u | condition) });
+            value<int32_t>(0);
+            return m_at - 4;
+        }
+
+        uint8_t* jump()
+        {
+            bytes({ 0xE9 });
+            value<int32_t>(0);
+            return m_at - 4;
+        }
+
+        static void bind(uint8_t* patch, const uint8_t* target)
+        {
+            auto distance = static_cast<int32_t>(target - (patch + 4));
+            memcpy(patch, &distance, sizeof(distance));
+        }
+
+        void call(const void* function)
+        {
+            // mov rdi, rbx; mov rax, imm64; call rax
+            bytes({ 0x48, 0x89, 0xDF, 0x48, 0xB8 });
+            value(reinterpret_cast<uint64_t>(function));
+            bytes({ 0xFF, 0xD0 });
+        }
+
+        void load_rsi(uint64_t immediate)
+        {
+            bytes({ 0x48, 0xBE });
+            value(immediate);
+        }
+
+        // jmp [rip + 0] followed by the 8 byte target, returns the slot
+        uint64_t* jump_through_slot(const uint8_t* target)
+        {
+            bytes({ 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 });
+            auto* slot = reinterpret_cast<uint64_t*>(m_at);
+            value(reinterpret_cast<uint64_t>(target));
+            return slot;
+        }
+
+    private:
+        uint8_t* m_at;
+    };
+
+    struct Offsets {
+        int32_t registers;
+        int32_t address_register;
+        int32_t program_counter;
+        int32_t delay_timer;
+        int32_t events;
+        int32_t stop_mask;
+    };
+
+    bool ends_block(Chip8::Operation operation)
+    {
+        using Chip8::Operation;
+        switch (operation) {
+        case Operation::None:
+        case Operation::Op00EE:
+        case Operation::Op1nnn:
+        case Operation::Op2nnn:
+        case Operation::Op3xkk:
+        case Operation::Op4xkk:
+        case Operation::Op5xy0:
+        case Operation::Op9xy0:
+        case Operation::OpBnnn:
+        case Operation::OpEx9E:
+        case Operation::OpExA1:
+        case Operation::OpF000:
+        case Operation::OpFx0A:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+#endif
+
+Chip8::Jit::Jit(Cpu& cpu, MemoryManager& memory)
+    : m_cpu(cpu)
+    , m_memory(memory)
+{
+#ifdef HAS_JIT
+    void* code = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code != MAP_FAILED) {
+        m_code = static_cast<uint8_t*>(code);
+        emit_stubs();
+    }
+#endif
+}
+
+Chip8::Jit::~Jit()
+{
+#ifdef HAS_JIT
+    if (m_code) {
+        munmap(m_code, CODE_SIZE);
+    }
+    m_memory.clear_translated();
+#endif
+}
+
+/**
+ * True when native code can be generated and executed on this host,
+ * checked once by mapping a page and making it executable the way the
+ * Jit does.
+ */
+bool Chip8::Jit::is_supported()
+{
+#ifdef HAS_JIT
+    static const bool supported = [] {
+        void* page = mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED) {
+            return false;
+        }
+        bool executable = mprotect(page, 4096, PROT_READ | PROT_EXEC) == 0;
+        munmap(page, 4096);
+        return executable;
+    }();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+Chip8::JitStats Chip8::Jit::get_stats() const
+{
+    return m_stats;
+}
+
+/**
+ * Switches the pages holding the given bytes of the code buffer between
+ * writable and executable.
+ */
+void Chip8::Jit::set_code_writable(const uint8_t* from, size_t bytes, bool writable)
+{
+#ifdef HAS_JIT
+    uintptr_t first = reinterpret_cast<uintptr_t>(from) & ~(CODE_PAGE_SIZE - 1);
+    uintptr_t last = (reinterpret_cast<uintptr_t>(from) + bytes + CODE_PAGE_SIZE - 1) & ~(CODE_PAGE_SIZE - 1);
+    mprotect(reinterpret_cast<void*>(first), last - first, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+#else
+    (void)from;
+    (void)bytes;
+    (void)writable;
+#endif
+}
+
+void Chip8::Jit::patch_slot(uint64_t* slot, const uint8_t* target)
+{
+    auto* at = reinterpret_cast<const uint8_t*>(slot);
+    // slots sit right behind their jmp and are rarely 8 byte aligned
+    auto address = reinterpret_cast<uint64_t>(target);
+    set_code_writable(at, sizeof(*slot), true);
+    memcpy(slot, &address, sizeof(address));
+    set_code_writable(at, sizeof(*slot), false);
+}
+
+/**
+ * enter(cpu, budget, body) sets up rbx and r13 and jumps into a block,
+ * leave returns the remaining budget to the dispatcher. Three pushes
+ * keep the stack 16 byte aligned for the calls made from blocks.
+ */
+void Chip8::Jit::emit_stubs()
+{
+#ifdef HAS_JIT
+    set_code_writable(m_code, CODE_PAGE_SIZE, true);
+    Emitter emitter(m_code);
+    m_enter = emitter.position();
+    // push rbx; push r12; push r13; mov rbx, rdi; mov r13, rsi; jmp rdx
+    emitter.bytes({ 0x53, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF5, 0xFF, 0xE2 });
+    m_leave = emitter.position();
+    // mov rax, r13; pop r13; pop r12; pop rbx; ret
+    emitter.bytes({ 0x4C, 0x89, 0xE8, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3 });
+    m_code_used = emitter.position() - m_code;
+    set_code_writable(m_code, CODE_PAGE_SIZE, false);
+#endif
+}
+
+/**
+ * Runs up to cycles instructions, translated where possible, and returns
+ * how many were left when an event in the Cpu's stop mask ended it.
+ */
+Common::u64 Chip8::Jit::run(Common::u64 cycles)
+{
+#ifdef HAS_JIT
+    using Entry = Common::u64 (*)(Cpu*, Common::u64, const uint8_t*);
+    auto enter = reinterpret_cast<Entry>(const_cast<uint8_t*>(m_enter));
+    while (cycles > 0 && !(m_cpu.m_events & m_cpu.m_stop_mask)) {
+        u32 first;
+        u32 last;
+        if (m_memory.take_translated_writes(first, last)) {
+            invalidate(first, last);
+        }
+        uint16_t address = m_cpu.m_program_counter;
+        const uint8_t* code = nullptr;
+        if (m_code && address + 1u < MemoryManager::CODE_SPACE_SIZE) {
+            code = m_entries[address].code;
+            if (!code) {
+                Block* block = compile(address);
+                code = block ? block->body : nullptr;
+            }
+        }
+        if (!code) {
+            m_cpu.execute_switch();
+            --cycles;
+            ++m_stats.interpreted;
+            continue;
+        }
+        cycles = enter(&m_cpu, cycles, code);
+    }
+    return cycles;
+#else
+    while (cycles > 0 && !(m_cpu.m_events & m_cpu.m_stop_mask)) {
+        m_cpu.execute_switch();
+        --cycles;
+    }
+    return cycles;
+#endif
+}
+
+void Chip8::Jit::call_handler(Cpu* cpu, uint64_t packed_instruction)
+{
+    Instruction instruction;
+    static_assert(sizeof(instruction) == sizeof(packed_instruction), "instructions are passed in a register");
+    memcpy(&instruction, &packed_instruction, sizeof(instruction));
+    cpu->execute_instruction(instruction);
+}
+
+void Chip8::Jit::call_idle_check(Cpu* cpu, uint64_t jump_address)
+{
+    cpu->check_idle_loop(static_cast<uint16_t>(jump_address));
+}
+
+bool Chip8::Jit::reserve(size_t bytes)
+{
+    if (m_code_used + bytes > CODE_SIZE) {
+        flush();
+    }
+    return m_code_used + bytes <= CODE_SIZE;
+}
+
+/**
+ * Translates the block starting at start. Returns nullptr for addresses
+ * that are left to the interpreter.
+ */
+Chip8::Jit::Block* Chip8::Jit::compile(uint16_t start)
+{
+#ifdef HAS_JIT
+    if (m_invalidations[start] >= MAX_INVALIDATIONS || !reserve(MAX_BLOCK_BYTES)) {
+        return nullptr;
+    }
+    // Cpu::set_quirks throws the translated code away
+    QuirkFlags quirks = get_quirk_flags(m_cpu.m_quirks);
+    Instruction instructions[MAX_BLOCK_INSTRUCTIONS];
+    unsigned int count = 0;
+    bool terminated = false;
+    for (u32 address = start; count < MAX_BLOCK_INSTRUCTIONS && address + 1 < MemoryManager::CODE_SPACE_SIZE && !terminated; address += 2) {
+        instructions[count] = m_memory.get_instruction_at(address);
+        instructions[count].operation = resolve_operation(instructions[count], quirks);
+        terminated = ends_block(instructions[count].operation);
+        ++count;
+    }
+
+    auto offset_of = [this](const void* field) {
+        return static_cast<int32_t>(reinterpret_cast<const uint8_t*>(field) - reinterpret_cast<const uint8_t*>(&m_cpu));
+    };
+    Offsets offsets {
+        .registers = offset_of(m_cpu.m_registers),
+        .address_register = offset_of(&m_cpu.m_address_register),
+        .program_counter = offset_of(&m_cpu.m_program_counter),
+        .delay_timer = offset_of(&m_cpu.m_delay_timer),
+        .events = offset_of(&m_cpu.m_events),
+        .stop_mask = offset_of(&m_cpu.m_stop_mask),
+    };
+    auto reg = [&offsets](unsigned int index) { return offsets.registers + static_cast<int32_t>(index); };
+    const int32_t flag = reg(0xF);
+
+    auto block = std::make_unique<Block>();
+    block->start = start;
+    block->end = static_cast<uint16_t>(start + 2 * count);
+    uint8_t* emit_start = m_code + m_code_used;
+    set_code_writable(emit_start, MAX_BLOCK_BYTES, true);
+    Emitter emitter(emit_start);
+    block->body = emitter.position();
+
+    auto exit_to = [&](u32 target) {
+        target &= 0xFFFFu;
+        emitter.store_imm16(offsets.program_counter, static_cast<uint16_t>(target));
+        if (target + 1 >= MemoryManager::CODE_SPACE_SIZE) {
+            Emitter::bind(emitter.jump(), m_leave);
+            return;
+        }
+        const uint8_t* linked = m_blocks[target] ? m_blocks[target]->body : m_leave;
+        block->exits.emplace_back(static_cast<uint16_t>(target), emitter.jump_through_slot(linked));
+    };
+    auto leave_on_events = [&]() {
+        emitter.load_eax(offsets.events);
+        emitter.and_eax(offsets.stop_mask);
+        Emitter::bind(emitter.jump_if(NotEqual), m_leave);
+    };
+    auto call_handler_at = [&](u32 address, const Instruction& instruction) {
+        uint64_t packed;
+        memcpy(&packed, &instruction, sizeof(packed));
+        emitter.store_imm16(offsets.program_counter, static_cast<uint16_t>(address + 2));
+        emitter.load_rsi(packed);
+        emitter.call(reinterpret_cast<const void*>(&Jit::call_handler));
+    };
+    // for instructions ending the block whose handler sets the program counter
+    auto call_handler_and_leave = [&](u32 address, const Instruction& instruction) {
+        call_handler_at(address, instruction);
+        Emitter::bind(emitter.jump(), m_leave);
+    };
+
+    for (unsigned int i = 0; i < count; i++) {
+        const Instruction& instruction = instructions[i];
+        u32 address = start + 2 * i;
+
+        if (!m_entries[address].code) {
+            m_entries[address] = { block.get(), emitter.position() };
+            block->entries.push_back(static_cast<uint16_t>(address));
+        }
+        // out of budget: stop in front of this instruction
+        emitter.bytes({ 0x4D, 0x85, 0xED }); // test r13, r13
+        if (i == 0) {
+            Emitter::bind(emitter.jump_if(Equal), m_leave);
+        } else {
+            uint8_t* has_budget = emitter.jump_if(NotEqual);
+            emitter.store_imm16(offsets.program_counter, static_cast<uint16_t>(address));
+            Emitter::bind(emitter.jump(), m_leave);
+            Emitter::bind(has_budget, emitter.position());
+        }
+        emitter.bytes({ 0x49, 0xFF, 0xCD }); // dec r13
+
+        uint8_t x = instruction.x;
+        uint8_t y = instruction.y;
+        switch (instruction.operation) {
+        case Operation::Op1nnn:
+            if (instruction.nnn <= address) {
+                emitter.store_imm16(offsets.program_counter, instruction.nnn);
+                emitter.load_rsi(address);
+                emitter.call(reinterpret_cast<const void*>(&Jit::call_idle_check));
+                leave_on_events();
+            }
+            exit_to(instruction.nnn);
+            break;
+        case Operation::Op3xkk:
+        case Operation::Op4xkk: {
+            if (quirks.skips_long_loads) {
+                // how far to skip depends on bytes outside of the block
+                call_handler_and_leave(address, instruction);
+                break;
+            }
+            emitter.compare_imm8(reg(x), instruction.kk);
+            uint8_t* skip = emitter.jump_if(instruction.operation == Operation::Op3xkk ? Equal : NotEqual);
+            exit_to(address + 2);
+            Emitter::bind(skip, emitter.position());
+            exit_to(address + 4);
+            break;
+        }
+        case Operation::Op5xy0:
+        case Operation::Op9xy0: {
+            if (quirks.skips_long_loads) {
+                call_handler_and_leave(address, instruction);
+                break;
+            }
+            emitter.load_al(reg(x));
+            emitter.compare_al(reg(y));
+            uint8_t* skip = emitter.jump_if(instruction.operation == Operation::Op5xy0 ? Equal : NotEqual);
+            exit_to(address + 2);
+            Emitter::bind(skip, emitter.position());
+            exit_to(address + 4);
+            break;
+        }
+        case Operation::Op6xkk:
+            emitter.store_imm8(reg(x), instruction.kk);
+            break;
+        case Operation::Op7xkk:
+            emitter.add_imm8(reg(x), instruction.kk);
+            break;
+        case Operation::Op8xy0:
+            emitter.load_al(reg(y));
+            emitter.store_al(reg(x));
+            break;
+        case Operation::Op8xy1:
+        case Operation::Op8xy2:
+        case Operation::Op8xy3: {
+            static const uint8_t opcodes[] = { 0x08, 0x20, 0x30 };
+            emitter.load_al(reg(x));
+            emitter.load_cl(reg(y));
+            emitter.bytes({ opcodes[static_cast<int>(instruction.operation) - static_cast<int>(Operation::Op8xy1)], 0xC8 });
+            emitter.store_al(reg(x));
+            if (quirks.logic_resets_vf) {
+                emitter.store_imm8(flag, 0);
+            }
+            break;
+        }
+        case Operation::Op8xy4:
+            // the sum is taken before VF is written
+            emitter.load_al(reg(x));
+            emitter.load_cl(reg(y));
+            emitter.bytes({ 0x00, 0xC8, 0x0F, 0x92, 0xC2 }); // add al, cl; setc dl
+            emitter.store_dl(flag);
+            emitter.store_al(reg(x));
+            break;
+        case Operation::Op8xy5:
+        case Operation::Op8xy7: {
+            // the handlers write VF first and then read the operands again
+            bool reverse = instruction.operation == Operation::Op8xy7;
+            emitter.load_al(reg(reverse ? y : x));
+            emitter.load_cl(reg(reverse ? x : y));
+            emitter.bytes({ 0x38, 0xC8, 0x0F, 0x97, 0xC2 }); // cmp al, cl; seta dl
+            emitter.store_dl(flag);
+            emitter.load_al(reg(reverse ? y : x));
+            emitter.load_cl(reg(reverse ? x : y));
+            emitter.bytes({ 0x28, 0xC8 }); // sub al, cl
+            emitter.store_al(reg(x));
+            break;
+        }
+        case Operation::Op8xy6:
+            emitter.load_al(reg(quirks.shift_uses_vy ? y : x));
+            emitter.bytes({ 0x24, 0x01 }); // and al, 1
+            emitter.store_al(flag);
+            emitter.load_al(reg(quirks.shift_uses_vy ? y : x));
+            emitter.bytes({ 0xD0, 0xE8 }); // shr al, 1
+            emitter.store_al(reg(x));
+            break;
+        case Operation::Op8xyE:
+            emitter.load_al(reg(quirks.shift_uses_vy ? y : x));
+            emitter.bytes({ 0xC0, 0xE8, 0x07 }); // shr al, 7
+            emitter.store_al(flag);
+            emitter.load_al(reg(quirks.shift_uses_vy ? y : x));
+            emitter.bytes({ 0xD0, 0xE0 }); // shl al, 1
+            emitter.store_al(reg(x));
+            break;
+        case Operation::OpAnnn:
+            emitter.store_imm16(offsets.address_register, instruction.nnn);
+            break;
+        case Operation::OpFx07:
+            emitter.load_al(offsets.delay_timer);
+            emitter.store_al(reg(x));
+            break;
+        case Operation::OpFx1E:
+            emitter.load_zero_extended_eax(reg(x));
+            emitter.add_ax(offsets.address_register);
+            break;
+        case Operation::OpFx29:
+            emitter.load_zero_extended_eax(reg(x));
+            emitter.bytes({ 0x8D, 0x44, 0x80, 0x50 }); // lea eax, [rax + rax * 4 + 0x50]
+            emitter.store_ax(offsets.address_register);
+            break;
+        default:
+            if (ends_block(instruction.operation)) {
+                call_handler_and_leave(address, instruction);
+                break;
+            }
+            call_handler_at(address, instruction);
+            leave_on_events();
+            if (instruction.operation == Operation::OpFx33 || instruction.operation == Operation::OpFx55 || instruction.operation == Operation::Op5xy2) {
+                // mov rax, imm64; cmp byte [rax], 0; jne leave
+                emitter.bytes({ 0x48, 0xB8 });
+                emitter.value(reinterpret_cast<uint64_t>(m_memory.get_translated_write_flag()));
+                emitter.bytes({ 0x80, 0x38, 0x00 });
+                Emitter::bind(emitter.jump_if(NotEqual), m_leave);
+            }
+            break;
+        }
+    }
+    if (!terminated) {
+        exit_to(block->end);
+    }
+    m_code_used = emitter.position() - m_code;
+    set_code_writable(emit_start, MAX_BLOCK_BYTES, false);
+
+    for (u32 position = block->start; position < block->end; position++) {
+        ++m_coverage[position];
+        m_memory.set_translated(position, true);
+    }
+    Block* compiled = block.get();
+    for (const auto& [target, slot] : compiled->exits) {
+        m_links[target].push_back({ compiled, slot });
+    }
+    for (const Link& link : m_links[start]) {
+        patch_slot(link.slot, compiled->body);
+    }
+    m_blocks[start] = std::move(block);
+    ++m_stats.blocks_compiled;
+    return compiled;
+#else
+    (void)start;
+    return nullptr;
+#endif
+}
+
+void Chip8::Jit::drop_block(Block* block)
+{
+    for (const auto& [target, slot] : block->exits) {
+        auto& links = m_links[target];
+        links.erase(std::remove_if(links.begin(), links.end(), [block](const Link& link) { return link.from == block; }), links.end());
+    }
+    for (const Link& link : m_links[block->start]) {
+        patch_slot(link.slot, m_leave);
+    }
+    for (uint16_t address : block->entries) {
+        m_entries[address] = {};
+    }
+    for (u32 position = block->start; position < block->end; position++) {
+        --m_coverage[position];
+        m_memory.set_translated(position, m_coverage[position] > 0);
+    }
+    ++m_stats.blocks_invalidated;
+    m_blocks[block->start].reset();
+}
+
+/**
+ * Drops every block overlapping the written bytes first to last. The
+ * native code stays in the buffer until the next flush. Start addresses
+ * that keep getting rewritten by small writes are left to the interpreter
+ * from then on.
+ */
+void Chip8::Jit::invalidate(u32 first, u32 last)
+{
+    bool small_write = last - first < 2 * MAX_BLOCK_INSTRUCTIONS;
+    u32 from = first > 2 * MAX_BLOCK_INSTRUCTIONS ? first - 2 * MAX_BLOCK_INSTRUCTIONS : 0;
+    for (u32 start = from; start <= last && start < MemoryManager::CODE_SPACE_SIZE; start++) {
+        Block* block = m_blocks[start].get();
+        if (!block || block->end <= first) {
+            continue;
+        }
+        if (small_write && m_invalidations[start] < MAX_INVALIDATIONS) {
+            ++m_invalidations[start];
+        }
+        drop_block(block);
+    }
+}
+
+/**
+ * Throws away all native code, used when the code buffer is full.
+ */
+void Chip8::Jit::flush()
+{
+    for (auto& block : m_blocks) {
+        block.reset();
+    }
+    for (auto& links : m_links) {
+        links.clear();
+    }
+    std::fill(std::begin(m_entries), std::end(m_entries), Entry {});
+    std::fill(std::begin(m_coverage), std::end(m_coverage), 0);
+    m_memory.clear_translated();
+    ++m_stats.flushes;
+    if (m_code) {
+        emit_stubs();
+    }
+}
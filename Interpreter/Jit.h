@@ -0,0 +1,122 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "Instruction.h"
+#include "Memory.h"
+#include <Types.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#    define HAS_JIT
+#endif
+
+namespace Chip8 {
+    class Cpu;
+
+    struct JitStats {
+        Common::u64 blocks_compiled;
+        Common::u64 blocks_invalidated;
+        Common::u64 flushes;
+        Common::u64 interpreted;
+    };
+
+    /**
+     * Translates basic blocks into x86-64 code. A block runs from its start
+     * address up to the first instruction that changes control flow (1nnn,
+     * 2nnn, 00EE, Bnnn, skips, Fx0A, F000) and keeps the Cpu state in
+     * memory, so the interpreter can take over between any two blocks. Simple
+     * instructions are emitted inline, everything else calls back into the
+     * interpreter's handler.
+     *
+     * Blocks are cached per start address and jump straight into each
+     * other when the target is known at translation time. Writes to
+     * translated bytes make the running block exit, the dispatcher then
+     * drops every block covering them before going on.
+     *
+     * The code buffer is never writable and executable at the same time,
+     * it is only made writable while a block is emitted or chain slots
+     * are patched.
+     */
+    class Jit final {
+    public:
+        Jit(Cpu& cpu, MemoryManager& memory);
+        ~Jit();
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+        Common::u64 run(Common::u64 cycles);
+        void flush();
+        JitStats get_stats() const;
+
+        static bool is_supported();
+
+    private:
+        struct Block;
+        struct Link {
+            Block* from;
+            uint64_t* slot;
+        };
+
+        Block* compile(uint16_t start);
+        void invalidate(u32 first, u32 last);
+        void drop_block(Block* block);
+        bool reserve(size_t bytes);
+        void emit_stubs();
+        void set_code_writable(const uint8_t* from, size_t bytes, bool writable);
+        void patch_slot(uint64_t* slot, const uint8_t* target);
+
+        static void call_handler(Cpu* cpu, uint64_t packed_instruction);
+        static void call_idle_check(Cpu* cpu, uint64_t jump_address);
+
+        static constexpr unsigned int MAX_BLOCK_INSTRUCTIONS = 32;
+        static constexpr size_t MAX_BLOCK_BYTES = 4096;
+        // blocks rewritten this often are left to the interpreter
+        static constexpr unsigned int MAX_INVALIDATIONS = 16;
+        static constexpr size_t CODE_SIZE = 4 << 20;
+        static constexpr uintptr_t CODE_PAGE_SIZE = 4096;
+
+        Cpu& m_cpu;
+        MemoryManager& m_memory;
+        uint8_t* m_code = nullptr;
+        size_t m_code_used = 0;
+        const uint8_t* m_enter = nullptr;
+        const uint8_t* m_leave = nullptr;
+
+        std::unique_ptr<Block> m_blocks[MemoryManager::CODE_SPACE_SIZE];
+        // native code for every translated instruction, so a block stopped
+        // by the budget can be resumed in the middle
+        struct Entry {
+            Block* block;
+            const uint8_t* code;
+        };
+        Entry m_entries[MemoryManager::CODE_SPACE_SIZE] {};
+        // chain slots of other blocks jumping to each address
+        std::vector<Link> m_links[MemoryManager::CODE_SPACE_SIZE];
+        uint8_t m_coverage[MemoryManager::CODE_SPACE_SIZE] {};
+        uint8_t m_invalidations[MemoryManager::CODE_SPACE_SIZE] {};
+        JitStats m_stats {};
+    };
+}
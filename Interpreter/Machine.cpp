@@ -0,0 +1,134 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Machine.h"
+#include "SaveState.h"
+#include <Print.h>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+Chip8::Machine::Machine()
+{
+    m_memory_manager = std::make_shared<MemoryManager>();
+    m_display = std::make_shared<DisplayBuffer>();
+    m_cpu = std::make_unique<Cpu>(m_memory_manager, m_display);
+}
+
+bool Chip8::Machine::load_program(const std::string& source_file)
+{
+    std::ifstream infile(source_file, std::ios::binary | std::ios::ate);
+    if (!infile.is_open()) {
+        return false;
+    }
+    std::streampos size = infile.tellg();
+    std::vector<char> buffer(size);
+
+    infile.seekg(0, std::ios::beg);
+    infile.read(buffer.data(), size);
+    load_program(buffer.data(), size);
+    return true;
+}
+
+void Chip8::Machine::load_program(const char* data, long size)
+{
+    m_memory_manager->place_program(data, size);
+}
+
+Chip8::Cpu& Chip8::Machine::get_cpu()
+{
+    return *m_cpu;
+}
+
+Chip8::MemoryManager& Chip8::Machine::get_memory()
+{
+    return *m_memory_manager;
+}
+
+Chip8::DisplayBuffer& Chip8::Machine::get_display()
+{
+    return *m_display;
+}
+
+void Chip8::Machine::save_state(MachineState& state) const
+{
+    m_cpu->save_state(state.cpu);
+    state.memory_size = m_memory_manager->get_size();
+    memcpy(state.memory, m_memory_manager->get_data(), state.memory_size);
+    memcpy(state.display, m_display->get_rows(), sizeof(state.display));
+    state.hires = m_display->is_hires();
+    state.planes = static_cast<uint8_t>(m_display->get_planes());
+}
+
+void Chip8::Machine::load_state(const MachineState& state)
+{
+    m_cpu->load_state(state.cpu);
+    m_memory_manager->load_data(state.memory, state.memory_size);
+    m_display->load_rows(state.display, state.hires, state.planes);
+}
+
+void Chip8::Machine::save_state(std::vector<uint8_t>& blob) const
+{
+    // filled up to memory_size, no need to clear the rest first
+    auto state = std::make_unique_for_overwrite<MachineState>();
+    save_state(*state);
+    encode_state(*state, blob);
+}
+
+bool Chip8::Machine::load_state(const std::vector<uint8_t>& blob)
+{
+    auto state = std::make_unique_for_overwrite<MachineState>();
+    if (!decode_state(blob, *state)) {
+        return false;
+    }
+    if (state->cpu.quirks != m_cpu->get_quirks()) {
+        Common::err("The state was saved with ", to_string(state->cpu.quirks), " quirks, not ", to_string(m_cpu->get_quirks()));
+        return false;
+    }
+    if (state->cpu.cycles_per_frame != m_cpu->get_cycles_per_frame()) {
+        Common::err("The state was saved at ", state->cpu.cycles_per_frame, " instructions per frame, not ", m_cpu->get_cycles_per_frame());
+        return false;
+    }
+    load_state(*state);
+    return true;
+}
+
+bool Chip8::Machine::save_state_file(const std::string& file) const
+{
+    std::vector<uint8_t> blob;
+    save_state(blob);
+    std::ofstream out(file, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(blob.data()), blob.size());
+    return out.good();
+}
+
+bool Chip8::Machine::load_state_file(const std::string& file)
+{
+    std::ifstream in(file, std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::vector<uint8_t> blob { std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+    return load_state(blob);
+}
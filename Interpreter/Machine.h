@@ -0,0 +1,68 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "Cpu.h"
+#include "DisplayBuffer.h"
+#include "Memory.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Chip8 {
+    struct MachineState {
+        CpuState cpu;
+        // only the first memory_size bytes of memory belong to the state
+        uint32_t memory_size = MemoryManager::MEMORY_SIZE;
+        uint8_t memory[MemoryManager::MEMORY_SIZE];
+        uint64_t display[DisplayBuffer::PLANE_COUNT * DisplayBuffer::WORD_COUNT];
+        bool hires;
+        uint8_t planes;
+    };
+
+    /**
+     * Cpu, memory and display wired together, without any dependency on
+     * SDL so it can be driven by the window as well as headless tools.
+     */
+    class alignas(Common::CACHE_LINE_SIZE) Machine final {
+    public:
+        Machine();
+        bool load_program(const std::string& source_file);
+        void load_program(const char* data, long size);
+        Cpu& get_cpu();
+        MemoryManager& get_memory();
+        DisplayBuffer& get_display();
+
+        void save_state(MachineState& state) const;
+        void load_state(const MachineState& state);
+        void save_state(std::vector<uint8_t>& blob) const;
+        bool load_state(const std::vector<uint8_t>& blob);
+        bool save_state_file(const std::string& file) const;
+        bool load_state_file(const std::string& file);
+
+    private:
+        std::shared_ptr<MemoryManager> m_memory_manager = nullptr;
+        std::shared_ptr<DisplayBuffer> m_display = nullptr;
+        std::unique_ptr<Cpu> m_cpu = nullptr;
+    };
+}
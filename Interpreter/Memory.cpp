@@ -23,7 +23,9 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Memory.h"
 #include <Assert.h>
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <iostream>
 
 using namespace Common;
@@ -50,7 +52,29 @@ uint8_t fontset[FONTSET_SIZE] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+const unsigned int LARGE_FONTSET_SIZE = 160;
+
+uint8_t large_fontset[LARGE_FONTSET_SIZE] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
 Chip8::MemoryManager::MemoryManager()
+    : m_decoded(m_size)
 {
     reset_memory();
     load_fontset();
@@ -61,21 +85,28 @@ void Chip8::MemoryManager::reset_memory()
     for (unsigned char& i : m_memory) {
         i = 0;
     }
+    invalidate_all_decoded();
 }
 
 void Chip8::MemoryManager::place_program(const char* data, long size)
 {
     int program_ptr = 0x200;
+    // anything that doesn't fit behind 0x200 is cut off
+    size = std::min<long>(size, MEMORY_SIZE - program_ptr);
+    if (program_ptr + size > m_size) {
+        require_size(MEMORY_SIZE);
+    }
     for (size_t i = 0; i < size; i++) {
         m_memory[program_ptr] = data[i];
         program_ptr++;
     }
+    invalidate_all_decoded();
 }
 
 void Chip8::MemoryManager::dump()
 {
     const size_t ROW_SIZE = 1 << 2;
-    for (size_t i = 0; i < MEMORY_SIZE; i++) {
+    for (size_t i = 0; i < m_size; i++) {
         if (i % ROW_SIZE == 0) {
             std::cout << '\n'
                       << std::flush;
@@ -84,12 +115,141 @@ void Chip8::MemoryManager::dump()
     }
 }
 
+/**
+ * Instructions are fetched from the same address space get_value reads,
+ * a program counter beyond its end and the second byte of an instruction
+ * at the very top wrap around.
+ */
 unsigned short Chip8::MemoryManager::get_at_position(const u32 position)
 {
     ensure_non_protected_access(position);
     ensure_non_protected_access(position + 1);
 
-    return m_memory[position] << 8 | m_memory[position + 1];
+    return m_memory[position & (m_size - 1)] << 8 | m_memory[(position + 1) & (m_size - 1)];
+}
+
+const Chip8::Instruction& Chip8::MemoryManager::get_instruction_at(u32 position)
+{
+    position &= m_size - 1;
+    Instruction& entry = m_decoded[position];
+    if (entry.operation != Operation::Count) {
+        ++m_decode_cache_stats.hits;
+        ensure_non_protected_access(position);
+        return entry;
+    }
+    ++m_decode_cache_stats.misses;
+    entry = decode(get_at_position(position));
+    if (m_fusion && position + 3 < m_size) {
+        Instruction& next = m_decoded[position + 2];
+        if (next.operation == Operation::Count) {
+            next = decode(get_at_position(position + 2));
+        }
+        entry.fusion = fuse(entry.operation, next.operation);
+    }
+    return entry;
+}
+
+/**
+ * The cached entry without decoding it first, the fused handlers read
+ * their second instruction from here. Its fields stay valid for as long
+ * as the fused entry in front of it is, a write to its bytes drops both.
+ */
+const Chip8::Instruction& Chip8::MemoryManager::get_decoded(u32 position) const
+{
+    return m_decoded[position & (m_size - 1)];
+}
+
+void Chip8::MemoryManager::set_fusion(bool enabled)
+{
+    m_fusion = enabled;
+    invalidate_all_decoded();
+}
+
+Chip8::DecodeCacheStats Chip8::MemoryManager::get_decode_cache_stats() const
+{
+    return m_decode_cache_stats;
+}
+
+/**
+ * A write to position changes the instruction starting there as well
+ * as the one starting a byte earlier, since instructions are 2 bytes
+ * wide and don't have to be aligned. Fused entries two and three bytes
+ * earlier cover it with their second instruction.
+ */
+void Chip8::MemoryManager::invalidate_decoded(const u32 position)
+{
+    if (position < CODE_SPACE_SIZE && m_translated[position]) {
+        note_translated_write(position, position);
+    }
+    if (m_decoded[position].operation != Operation::Count) {
+        m_decoded[position].operation = Operation::Count;
+        ++m_decode_cache_stats.invalidations;
+    }
+    if (position > 0 && m_decoded[position - 1].operation != Operation::Count) {
+        m_decoded[position - 1].operation = Operation::Count;
+        ++m_decode_cache_stats.invalidations;
+    }
+    for (u32 fused = position > 3 ? position - 3 : 0; fused + 1 < position; fused++) {
+        if (m_decoded[fused].operation != Operation::Count && m_decoded[fused].fusion != Fusion::None) {
+            m_decoded[fused].operation = Operation::Count;
+            ++m_decode_cache_stats.invalidations;
+        }
+    }
+}
+
+void Chip8::MemoryManager::invalidate_all_decoded()
+{
+    for (u32 position = 0; position < m_size; position++) {
+        m_decoded[position].operation = Operation::Count;
+    }
+    note_translated_write(0, m_size - 1);
+}
+
+void Chip8::MemoryManager::note_translated_write(u32 first, u32 last)
+{
+    if (!m_translated_written) {
+        m_translated_first = first;
+        m_translated_last = last;
+        m_translated_written = true;
+        return;
+    }
+    m_translated_first = std::min(m_translated_first, first);
+    m_translated_last = std::max(m_translated_last, last);
+}
+
+void Chip8::MemoryManager::set_translated(u32 position, bool translated)
+{
+    m_translated[position] = translated;
+}
+
+void Chip8::MemoryManager::clear_translated()
+{
+    std::fill(std::begin(m_translated), std::end(m_translated), false);
+    m_translated_written = false;
+}
+
+/**
+ * Hands out the range of translated bytes written since the last call,
+ * returns false when there was none.
+ */
+bool Chip8::MemoryManager::take_translated_writes(u32& first, u32& last)
+{
+    if (!m_translated_written) {
+        return false;
+    }
+    first = m_translated_first;
+    last = m_translated_last;
+    m_translated_written = false;
+    return true;
+}
+
+/**
+ * Set as soon as a translated byte is written, native code polls it
+ * after every instruction that writes memory.
+ */
+const bool* Chip8::MemoryManager::get_translated_write_flag() const
+{
+    return &m_translated_written;
 }
 
 void Chip8::MemoryManager::ensure_non_protected_access(const u32 position)
@@ -111,13 +271,82 @@ void Chip8::MemoryManager::load_fontset()
     for (size_t i = 0; i < FONTSET_SIZE; i++) {
         m_memory[FONTSET_STAT_ADDRESS + i] = fontset[i];
     }
+    for (size_t i = 0; i < LARGE_FONTSET_SIZE; i++) {
+        m_memory[LARGE_FONT_ADDRESS + i] = large_fontset[i];
+    }
 }
+/**
+ * I can be moved past the end of memory (Fx1E, or Fx55 and Fx65 with
+ * the quirk that increments it), the accesses through it wrap around
+ * at the end of the address space, 4 KB unless it is an XO-CHIP one.
+ */
 uint8_t Chip8::MemoryManager::get_value(uint32_t position)
 {
-    return m_memory[position];
+    return m_memory[position & (m_size - 1)];
+}
+
+const uint8_t* Chip8::MemoryManager::get_data() const
+{
+    return m_memory;
+}
+
+/**
+ * How many bytes the program can address, CODE_SPACE_SIZE unless it
+ * needed the XO-CHIP 64 KB. Snapshots and state restores only cover
+ * these.
+ */
+Chip8::u32 Chip8::MemoryManager::get_size() const
+{
+    return m_size;
+}
+
+/**
+ * Grows the address space to size, a power of two no larger than
+ * MEMORY_SIZE. It never shrinks, the bytes it gains are still zero.
+ */
+void Chip8::MemoryManager::require_size(u32 size)
+{
+    if (size <= m_size) {
+        return;
+    }
+    m_decoded.resize(size);
+    for (u32 position = m_size; position < size; position++) {
+        m_decoded[position].operation = Operation::Count;
+    }
+    m_size = size;
+}
+
+/**
+ * Replaces the address space with size bytes from data, anything above
+ * is cleared. Only the decoded instructions overlapping bytes that
+ * actually changed are dropped, restoring a snapshot of a running
+ * program mostly leaves the decode cache intact.
+ */
+void Chip8::MemoryManager::load_data(const uint8_t* data, u32 size)
+{
+    require_size(size);
+    for (u32 position = 0; position < size; position += CACHE_LINE_SIZE) {
+        if (memcmp(m_memory + position, data + position, CACHE_LINE_SIZE) == 0) {
+            continue;
+        }
+        for (u32 i = position; i < position + CACHE_LINE_SIZE; i++) {
+            if (m_memory[i] != data[i]) {
+                m_memory[i] = data[i];
+                invalidate_decoded(i);
+            }
+        }
+    }
+    for (u32 position = size; position < m_size; position++) {
+        if (m_memory[position] != 0) {
+            m_memory[position] = 0;
+            invalidate_decoded(position);
+        }
+    }
 }
 
 void Chip8::MemoryManager::set_value(uint32_t position, uint8_t value)
 {
+    position &= m_size - 1;
     m_memory[position] = value;
+    invalidate_decoded(position);
 }
@@ -22,27 +22,77 @@
 // OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
+#include "Instruction.h"
 #include <Types.h>
+#include <vector>
 
 namespace Chip8 {
     using namespace Common;
-    class MemoryManager final {
+
+    struct DecodeCacheStats {
+        u64 hits;
+        u64 misses;
+        u64 invalidations;
+    };
+
+    class alignas(CACHE_LINE_SIZE) MemoryManager final {
     public:
+        // the XO-CHIP address space, I reaches all of it through F000 NNNN.
+        // Only XO-CHIP programs get all of it, everything else stays in
+        // the first CODE_SPACE_SIZE bytes, see require_size
+        static constexpr u32 MEMORY_SIZE = 1 << 16;
+        // jumps and calls take 12 bit addresses, the Jit and recompiled
+        // programs only cover code below this and leave the rest to the
+        // interpreter
+        static constexpr u32 CODE_SPACE_SIZE = 1 << 12;
+        // the 8x10 SUPER-CHIP digits Fx30 points I at, behind the small ones
+        static constexpr u32 LARGE_FONT_ADDRESS = 0xA0;
+
         MemoryManager();
         void place_program(const char* data, long size);
         void dump();
         unsigned short get_at_position(u32 position);
+        const Instruction& get_instruction_at(u32 position);
+        const Instruction& get_decoded(u32 position) const;
+        void set_fusion(bool enabled);
+        DecodeCacheStats get_decode_cache_stats() const;
         void set_value(uint32_t position, uint8_t value);
         uint8_t get_value(uint32_t position);
         bool is_program_end(u32 position);
+        const uint8_t* get_data() const;
+        u32 get_size() const;
+        void require_size(u32 size);
+        void load_data(const uint8_t* data, u32 size);
+        void set_translated(u32 position, bool translated);
+        void clear_translated();
+        bool take_translated_writes(u32& first, u32& last);
+        const bool* get_translated_write_flag() const;
     private:
         void reset_memory();
         void load_fontset();
         static void ensure_non_protected_access(u32 position);
+        void invalidate_decoded(u32 position);
+        void invalidate_all_decoded();
+        void note_translated_write(u32 first, u32 last);
 
     private:
-        static constexpr u32 MEMORY_SIZE = 1 << 12;
         uint8_t m_memory[MEMORY_SIZE] = {};
+        // addresses wrap at this size, the bytes above it are always zero
+        u32 m_size = CODE_SPACE_SIZE;
+
+        // lazily filled per address up to m_size, an operation of
+        // Operation::Count marks an entry that has not been decoded yet
+        std::vector<Instruction> m_decoded;
+        DecodeCacheStats m_decode_cache_stats {};
+        bool m_fusion = true;
+
+        // bytes the Jit has translated into native code, writes to them
+        // are collected until the Jit drops the affected blocks. Only the
+        // code space is ever translated
+        bool m_translated[CODE_SPACE_SIZE] = {};
+        bool m_translated_written = false;
+        u32 m_translated_first = 0;
+        u32 m_translated_last = 0;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,160 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+#include <string>
+#include <vector>
+
+Chip8::Profiler::Profiler()
+{
+    reset();
+}
+
+void Chip8::Profiler::reset()
+{
+    std::fill(std::begin(m_operation_count), std::end(m_operation_count), 0);
+    std::fill(std::begin(m_operation_ticks), std::end(m_operation_ticks), 0);
+    std::fill(std::begin(m_address_count), std::end(m_address_count), 0);
+    std::fill(std::begin(m_address_operation), std::end(m_address_operation), Operation::None);
+    m_pair_count.assign(OPERATION_COUNT * OPERATION_COUNT, 0);
+    m_triple_count.assign(OPERATION_COUNT * OPERATION_COUNT * OPERATION_COUNT, 0);
+    m_last_address = 0;
+    m_last_was_sequential = false;
+    m_overhead_ticks = ~Common::u64 { 0 };
+    for (int i = 0; i < 1000; i++) {
+        Common::u64 start = now();
+        m_overhead_ticks = std::min(m_overhead_ticks, now() - start);
+    }
+    m_start_ticks = now();
+    m_start_time = std::chrono::steady_clock::now();
+}
+
+/**
+ * Operations sorted by the time spent in them, followed by the hottest
+ * addresses. Instructions skipped by idle loop fast forwarding never ran
+ * and don't show up.
+ */
+void Chip8::Profiler::write_report(std::ostream& out) const
+{
+    double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_start_time).count();
+    Common::u64 elapsed_ticks = now() - m_start_ticks;
+    double ns_per_tick = elapsed_ticks > 0 ? elapsed_ns / static_cast<double>(elapsed_ticks) : 1.0;
+    Common::u64 total = std::accumulate(std::begin(m_operation_count), std::end(m_operation_count), Common::u64 { 0 });
+    Common::u64 operation_ticks[OPERATION_COUNT];
+    for (unsigned int index = 0; index < OPERATION_COUNT; index++) {
+        Common::u64 overhead = m_operation_count[index] * m_overhead_ticks;
+        operation_ticks[index] = m_operation_ticks[index] > overhead ? m_operation_ticks[index] - overhead : 0;
+    }
+    Common::u64 total_ticks = std::accumulate(std::begin(operation_ticks), std::end(operation_ticks), Common::u64 { 0 });
+    auto share = [](Common::u64 part, Common::u64 whole) {
+        return whole > 0 ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+    };
+
+    std::vector<unsigned int> operations(OPERATION_COUNT);
+    std::iota(operations.begin(), operations.end(), 0);
+    std::sort(operations.begin(), operations.end(), [&operation_ticks](unsigned int a, unsigned int b) {
+        return operation_ticks[a] > operation_ticks[b];
+    });
+    out << "profile: " << total << " instructions, " << std::fixed << std::setprecision(2)
+        << static_cast<double>(total_ticks) * ns_per_tick / 1e6 << " ms in handlers\n"
+        << std::left << std::setw(10) << "operation" << std::right << std::setw(14) << "count"
+        << std::setw(9) << "count %" << std::setw(14) << "ns" << std::setw(9) << "time %" << std::setw(10) << "ns/op" << '\n';
+    for (unsigned int index : operations) {
+        if (m_operation_count[index] == 0) {
+            continue;
+        }
+        double ns = static_cast<double>(operation_ticks[index]) * ns_per_tick;
+        out << std::left << std::setw(10) << to_string(static_cast<Operation>(index)) << std::right
+            << std::setw(14) << m_operation_count[index]
+            << std::setw(9) << share(m_operation_count[index], total)
+            << std::setw(14) << static_cast<Common::u64>(ns)
+            << std::setw(9) << share(operation_ticks[index], total_ticks)
+            << std::setw(10) << ns / static_cast<double>(m_operation_count[index]) << '\n';
+    }
+
+    std::vector<uint16_t> addresses;
+    for (unsigned int address = 0; address < MemoryManager::MEMORY_SIZE; address++) {
+        if (m_address_count[address] > 0) {
+            addresses.push_back(address);
+        }
+    }
+    auto hot = std::min<size_t>(addresses.size(), HOT_ADDRESSES);
+    std::partial_sort(addresses.begin(), addresses.begin() + hot, addresses.end(), [this](uint16_t a, uint16_t b) {
+        return m_address_count[a] != m_address_count[b] ? m_address_count[a] > m_address_count[b] : a < b;
+    });
+    out << "hottest addresses:\n";
+    for (size_t i = 0; i < hot; i++) {
+        uint16_t address = addresses[i];
+        out << "  " << Common::int_to_hex(address) << "  " << std::left << std::setw(8) << to_string(m_address_operation[address])
+            << std::right << std::setw(14) << m_address_count[address]
+            << std::setw(9) << share(m_address_count[address], total) << '\n';
+    }
+    write_sequences(out);
+}
+
+/**
+ * The most frequent pairs and triples, each with its share of all
+ * sequences of that length.
+ */
+void Chip8::Profiler::write_sequences(std::ostream& out) const
+{
+    auto write_hottest = [&out](const char* title, const std::vector<Common::u64>& counts, unsigned int length) {
+        Common::u64 total = std::accumulate(counts.begin(), counts.end(), Common::u64 { 0 });
+        std::vector<unsigned int> sequences;
+        for (unsigned int index = 0; index < counts.size(); index++) {
+            if (counts[index] > 0) {
+                sequences.push_back(index);
+            }
+        }
+        auto hot = std::min<size_t>(sequences.size(), HOT_SEQUENCES);
+        std::partial_sort(sequences.begin(), sequences.begin() + hot, sequences.end(), [&counts](unsigned int a, unsigned int b) {
+            return counts[a] != counts[b] ? counts[a] > counts[b] : a < b;
+        });
+        out << title << ":\n";
+        for (size_t i = 0; i < hot; i++) {
+            std::string name;
+            for (unsigned int position = length, rest = sequences[i]; position > 0; position--, rest /= OPERATION_COUNT) {
+                name = std::string(to_string(static_cast<Operation>(rest % OPERATION_COUNT))) + (name.empty() ? "" : " ") + name;
+            }
+            out << "  " << std::left << std::setw(16) << name << std::right << std::setw(14) << counts[sequences[i]]
+                << std::setw(9) << std::fixed << std::setprecision(2)
+                << (total > 0 ? 100.0 * static_cast<double>(counts[sequences[i]]) / static_cast<double>(total) : 0.0) << '\n';
+        }
+    };
+    write_hottest("hottest pairs", m_pair_count, 2);
+    write_hottest("hottest triples", m_triple_count, 3);
+    out << std::defaultfloat << std::flush;
+}
+
+void Chip8::Profiler::add_sequences(const Profiler& other)
+{
+    for (size_t index = 0; index < m_pair_count.size(); index++) {
+        m_pair_count[index] += other.m_pair_count[index];
+    }
+    for (size_t index = 0; index < m_triple_count.size(); index++) {
+        m_triple_count[index] += other.m_triple_count[index];
+    }
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "Instruction.h"
+#include "Memory.h"
+#include <Types.h>
+#include <chrono>
+#include <ostream>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#    include <x86intrin.h>
+#endif
+
+namespace Chip8 {
+    /**
+     * Execution counts per operation and per address plus the host time
+     * spent in every operation. Only compiled into the Cpu when the build
+     * is configured with -DCHIP8_PROFILER=ON, otherwise none of this is
+     * on the execution path.
+     *
+     * Time is taken in raw timestamp counter ticks and converted to
+     * nanoseconds when the report is written.
+     *
+     * Runs of two and three instructions executed back to back at
+     * consecutive addresses are counted as well, they are the candidates
+     * for fusion. Sequences can be summed up over several runs to find
+     * the ones common across a set of ROMs.
+     */
+    class Profiler final {
+    public:
+        Profiler();
+        void reset();
+        void write_report(std::ostream& out) const;
+        void write_sequences(std::ostream& out) const;
+        void add_sequences(const Profiler& other);
+
+        static Common::u64 now()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        void record(uint16_t address, Operation operation, Common::u64 ticks)
+        {
+            auto index = static_cast<unsigned int>(operation);
+            ++m_operation_count[index];
+            m_operation_ticks[index] += ticks;
+            ++m_address_count[address % MemoryManager::MEMORY_SIZE];
+            m_address_operation[address % MemoryManager::MEMORY_SIZE] = operation;
+            record_sequence(address, operation);
+        }
+
+    private:
+        static constexpr unsigned int OPERATION_COUNT = static_cast<unsigned int>(Operation::Count);
+        static constexpr unsigned int HOT_ADDRESSES = 24;
+        static constexpr unsigned int HOT_SEQUENCES = 12;
+
+        void record_sequence(uint16_t address, Operation operation)
+        {
+            auto index = static_cast<unsigned int>(operation);
+            if (address == static_cast<uint16_t>(m_last_address + 2)) {
+                unsigned int pair = m_last_operation * OPERATION_COUNT + index;
+                ++m_pair_count[pair];
+                if (m_last_was_sequential) {
+                    ++m_triple_count[m_second_last_operation * OPERATION_COUNT * OPERATION_COUNT + pair];
+                }
+                m_last_was_sequential = true;
+            } else {
+                m_last_was_sequential = false;
+            }
+            m_second_last_operation = m_last_operation;
+            m_last_operation = index;
+            m_last_address = address;
+        }
+
+        Common::u64 m_operation_count[OPERATION_COUNT] {};
+        Common::u64 m_operation_ticks[OPERATION_COUNT] {};
+        Common::u64 m_address_count[MemoryManager::MEMORY_SIZE] {};
+        Operation m_address_operation[MemoryManager::MEMORY_SIZE] {};
+
+        // indexed by first * OPERATION_COUNT + second (+ third)
+        std::vector<Common::u64> m_pair_count;
+        std::vector<Common::u64> m_triple_count;
+        uint16_t m_last_address = 0;
+        unsigned int m_last_operation = 0;
+        unsigned int m_second_last_operation = 0;
+        bool m_last_was_sequential = false;
+
+        // taken at reset so ticks can be calibrated against wall time
+        Common::u64 m_start_ticks = 0;
+        std::chrono::steady_clock::time_point m_start_time;
+        // cost of reading the clock twice, subtracted from every record
+        Common::u64 m_overhead_ticks = 0;
+    };
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Quirks.h"
+
+namespace {
+    template<typename Q>
+    constexpr Chip8::QuirkFlags flags_of()
+    {
+        return { Q::shift_uses_vy, Q::load_store_increments_i, Q::jump_uses_vx, Q::logic_resets_vf, Q::sprites_wrap, Q::skips_long_loads, Q::large_sprites, Q::xo_chip_opcodes };
+    }
+
+    bool ends_with(const std::string& text, const std::string& suffix)
+    {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+}
+
+const char* Chip8::to_string(QuirkProfile profile)
+{
+    switch (profile) {
+    case QuirkProfile::Modern:
+        return "modern";
+    case QuirkProfile::Chip8:
+        return "chip8";
+    case QuirkProfile::SuperChip:
+        return "schip";
+    case QuirkProfile::XoChip:
+        return "xochip";
+    }
+    return "unknown";
+}
+
+bool Chip8::parse_quirks(const std::string& name, QuirkProfile& profile)
+{
+    for (QuirkProfile candidate : { QuirkProfile::Modern, QuirkProfile::Chip8, QuirkProfile::SuperChip, QuirkProfile::XoChip }) {
+        if (name == to_string(candidate)) {
+            profile = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+Chip8::QuirkProfile Chip8::quirks_for_file(const std::string& file)
+{
+    if (ends_with(file, ".sc8")) {
+        return QuirkProfile::SuperChip;
+    }
+    if (ends_with(file, ".xo8")) {
+        return QuirkProfile::XoChip;
+    }
+    return QuirkProfile::Modern;
+}
+
+Chip8::QuirkFlags Chip8::get_quirk_flags(QuirkProfile profile)
+{
+    switch (profile) {
+    case QuirkProfile::Chip8:
+        return flags_of<Chip8Quirks>();
+    case QuirkProfile::SuperChip:
+        return flags_of<SuperChipQuirks>();
+    case QuirkProfile::XoChip:
+        return flags_of<XoChipQuirks>();
+    case QuirkProfile::Modern:
+        break;
+    }
+    return flags_of<ModernQuirks>();
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include <string>
+
+namespace Chip8 {
+    /**
+     * The interpreters that grew out of the original CHIP-8 disagree on a
+     * handful of instructions. Modern is what most references describe and
+     * what this interpreter always did, the others follow the COSMAC VIP,
+     * SUPER-CHIP 1.1 and XO-CHIP.
+     */
+    enum class QuirkProfile {
+        Modern,
+        Chip8,
+        SuperChip,
+        XoChip
+    };
+
+    const char* to_string(QuirkProfile profile);
+    bool parse_quirks(const std::string& name, QuirkProfile& profile);
+    // picks the profile from the extension, .sc8 and .xo8 are the usual ones
+    QuirkProfile quirks_for_file(const std::string& file);
+
+    /**
+     * One profile as compile time constants, the handlers are instantiated
+     * once per profile so none of this is decided while executing.
+     */
+    template<bool ShiftUsesVy, bool LoadStoreIncrementsI, bool JumpUsesVx, bool LogicResetsVf, bool SpritesWrap, bool SkipsLongLoads, bool LargeSprites, bool XoChipOpcodes>
+    struct Quirks {
+        // 8xy6 and 8xyE shift Vy into Vx instead of shifting Vx
+        static constexpr bool shift_uses_vy = ShiftUsesVy;
+        // Fx55 and Fx65 leave I pointing behind the last register
+        static constexpr bool load_store_increments_i = LoadStoreIncrementsI;
+        // Bnnn is Bxnn and jumps to xnn + Vx
+        static constexpr bool jump_uses_vx = JumpUsesVx;
+        // 8xy1, 8xy2 and 8xy3 clear VF
+        static constexpr bool logic_resets_vf = LogicResetsVf;
+        // sprites wrap around the edges instead of being clipped
+        static constexpr bool sprites_wrap = SpritesWrap;
+        // the skips step over all four bytes of an XO-CHIP F000 NNNN
+        static constexpr bool skips_long_loads = SkipsLongLoads;
+        // Dxy0 draws 16x16 and the SUPER-CHIP 00Cn, 00FB, 00FC, 00FE, 00FF
+        // and Fx30 exist, otherwise Dxy0 draws no rows and those fall back
+        // to what they did before, see resolve_operation
+        static constexpr bool large_sprites = LargeSprites;
+        // the XO-CHIP 00Dn, 5xy2, 5xy3, F000, Fn01, F002 and Fx3A exist,
+        // with the same fallback
+        static constexpr bool xo_chip_opcodes = XoChipOpcodes;
+    };
+
+    using ModernQuirks = Quirks<false, false, false, false, false, false, false, false>;
+    using Chip8Quirks = Quirks<true, true, false, true, false, false, false, false>;
+    using SuperChipQuirks = Quirks<false, false, true, false, false, false, true, false>;
+    using XoChipQuirks = Quirks<true, true, false, false, true, true, true, true>;
+
+    /**
+     * The same as a value for the code that has to look at the profile
+     * at runtime, the Jit and the recompiler.
+     */
+    struct QuirkFlags {
+        bool shift_uses_vy;
+        bool load_store_increments_i;
+        bool jump_uses_vx;
+        bool logic_resets_vf;
+        bool sprites_wrap;
+        bool skips_long_loads;
+        bool large_sprites;
+        bool xo_chip_opcodes;
+    };
+
+    QuirkFlags get_quirk_flags(QuirkProfile profile);
+}
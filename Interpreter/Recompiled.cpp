@@ -0,0 +1,204 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Recompiled.h"
+#include "Cpu.h"
+#include <Print.h>
+#include <algorithm>
+#ifdef HAS_RECOMPILED_PLUGINS
+#    include <dlfcn.h>
+#endif
+
+static constexpr Chip8::u32 PROGRAM_START = 0x200;
+
+Chip8::RecompiledProgram::RecompiledProgram(Cpu& cpu, MemoryManager& memory)
+    : m_cpu(cpu)
+    , m_memory(memory)
+{
+}
+
+Chip8::RecompiledProgram::~RecompiledProgram()
+{
+    if (m_active) {
+        m_memory.clear_translated();
+    }
+#ifdef HAS_RECOMPILED_PLUGINS
+    if (m_handle) {
+        dlclose(m_handle);
+    }
+#endif
+}
+
+/**
+ * Loads the plugin and checks that it was generated from the program in
+ * memory, it stays inactive when anything doesn't fit.
+ */
+bool Chip8::RecompiledProgram::load(const std::string& file)
+{
+#ifdef HAS_RECOMPILED_PLUGINS
+    m_handle = dlopen(file.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!m_handle) {
+        Common::err("Failed to load ", file, ": ", dlerror());
+        return false;
+    }
+    auto entry = reinterpret_cast<Chip8RecompiledEntry>(dlsym(m_handle, CHIP8_RECOMPILED_SYMBOL));
+    m_rom = entry ? entry() : nullptr;
+    if (!m_rom || m_rom->abi_version != CHIP8_RECOMPILED_ABI_VERSION) {
+        Common::err(file, " is not a recompiled program for this interpreter");
+        m_rom = nullptr;
+        return false;
+    }
+    if (m_rom->quirks != static_cast<uint32_t>(m_cpu.m_quirks)) {
+        Common::err(file, " was recompiled for other quirks than ", to_string(m_cpu.m_quirks));
+        m_rom = nullptr;
+        return false;
+    }
+    if (m_rom->image_size > MemoryManager::MEMORY_SIZE - PROGRAM_START) {
+        Common::err(file, " has an invalid program image");
+        m_rom = nullptr;
+        return false;
+    }
+    u32 image_end = PROGRAM_START + m_rom->image_size;
+    for (u32 i = 0; i < m_rom->address_count; i++) {
+        u32 address = m_rom->addresses[i];
+        if (address < PROGRAM_START || address + 2 > image_end || address + 1 >= MemoryManager::CODE_SPACE_SIZE) {
+            Common::err(file, " has an instruction outside of its program image");
+            m_rom = nullptr;
+            return false;
+        }
+        m_entries[address] = true;
+    }
+    m_memory.clear_translated();
+    for (u32 address = 0; address < MemoryManager::CODE_SPACE_SIZE; address++) {
+        if (m_entries[address]) {
+            m_memory.set_translated(address, true);
+            m_memory.set_translated(address + 1, true);
+        }
+    }
+    if (!matches_memory(PROGRAM_START, image_end - 1)) {
+        Common::err(file, " was recompiled from a different program");
+        m_memory.clear_translated();
+        m_rom = nullptr;
+        return false;
+    }
+
+    m_context = {
+        .registers = m_cpu.m_registers,
+        .address_register = &m_cpu.m_address_register,
+        .program_counter = &m_cpu.m_program_counter,
+        .stack = m_cpu.m_stack,
+        .sp = &m_cpu.m_sp,
+        .delay_timer = &m_cpu.m_delay_timer,
+        .memory = m_memory.get_data(),
+        .idle_pure = &m_cpu.m_idle_check.pure,
+        .code_written = m_memory.get_translated_write_flag(),
+        .cpu = &m_cpu,
+        .execute = call_execute,
+        .idle_check = call_idle_check
+    };
+    m_active = true;
+    return true;
+#else
+    Common::err("Recompiled programs are not supported on this platform, can't load ", file);
+    return false;
+#endif
+}
+
+bool Chip8::RecompiledProgram::is_active() const
+{
+    return m_active;
+}
+
+Chip8::QuirkProfile Chip8::RecompiledProgram::get_quirks() const
+{
+    return m_rom ? static_cast<QuirkProfile>(m_rom->quirks) : QuirkProfile::Modern;
+}
+
+/**
+ * Same contract as Jit::run. Instructions the plugin doesn't cover run on
+ * the interpreter one at a time until the program counter is back at one
+ * it does.
+ */
+Common::u64 Chip8::RecompiledProgram::run(Common::u64 cycles)
+{
+    while (cycles > 0 && !(m_cpu.m_events & m_cpu.m_stop_mask)) {
+        u32 first;
+        u32 last;
+        if (m_active && m_memory.take_translated_writes(first, last) && !matches_memory(first, last)) {
+            deactivate();
+        }
+        uint16_t address = m_cpu.m_program_counter;
+        if (m_active && address < MemoryManager::CODE_SPACE_SIZE && m_entries[address]) {
+            cycles = m_rom->run(&m_context, cycles);
+            continue;
+        }
+        m_cpu.execute_switch();
+        --cycles;
+    }
+    return cycles;
+}
+
+/**
+ * True when every recompiled instruction overlapping first..last still
+ * has the bytes it was translated from.
+ */
+bool Chip8::RecompiledProgram::matches_memory(u32 first, u32 last) const
+{
+    if (m_rom->image_size < 2) {
+        return true;
+    }
+    const uint8_t* memory = m_memory.get_data();
+    u32 start = first > PROGRAM_START ? first - 1 : PROGRAM_START;
+    u32 end = std::min({ last, PROGRAM_START + m_rom->image_size - 2, MemoryManager::CODE_SPACE_SIZE - 1 });
+    for (u32 address = start; address <= end; address++) {
+        if (!m_entries[address]) {
+            continue;
+        }
+        const uint8_t* expected = m_rom->image + (address - PROGRAM_START);
+        if (memory[address] != expected[0] || memory[address + 1] != expected[1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Chip8::RecompiledProgram::deactivate()
+{
+    Common::err("Recompiled code was overwritten, continuing on the interpreter\n");
+    m_active = false;
+    m_memory.clear_translated();
+}
+
+int Chip8::RecompiledProgram::call_execute(void* cpu, uint16_t opcode)
+{
+    Cpu& target = *static_cast<Cpu*>(cpu);
+    target.execute_instruction(decode(opcode));
+    return (target.m_events & target.m_stop_mask) != 0;
+}
+
+int Chip8::RecompiledProgram::call_idle_check(void* cpu, uint16_t jump_address)
+{
+    Cpu& target = *static_cast<Cpu*>(cpu);
+    target.check_idle_loop(jump_address);
+    return (target.m_events & target.m_stop_mask) != 0;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "Memory.h"
+#include "Quirks.h"
+#include "RecompiledAbi.h"
+#include <Types.h>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#    define HAS_RECOMPILED_PLUGINS
+#endif
+
+namespace Chip8 {
+    class Cpu;
+
+    /**
+     * A ROM translated ahead of time by chip8_recompile and loaded from a
+     * shared library. It takes over whenever the program counter is at one
+     * of its instructions, everything else is left to the interpreter.
+     *
+     * The translated instructions are marked in the MemoryManager. Once a
+     * write changes one of them the plugin is switched off, the program
+     * keeps running on the interpreter from there on.
+     */
+    class RecompiledProgram final {
+    public:
+        RecompiledProgram(Cpu& cpu, MemoryManager& memory);
+        ~RecompiledProgram();
+        RecompiledProgram(const RecompiledProgram&) = delete;
+        RecompiledProgram& operator=(const RecompiledProgram&) = delete;
+
+        bool load(const std::string& file);
+        bool is_active() const;
+        QuirkProfile get_quirks() const;
+        Common::u64 run(Common::u64 cycles);
+
+    private:
+        bool matches_memory(u32 first, u32 last) const;
+        void deactivate();
+
+        static int call_execute(void* cpu, uint16_t opcode);
+        static int call_idle_check(void* cpu, uint16_t jump_address);
+
+        Cpu& m_cpu;
+        MemoryManager& m_memory;
+        void* m_handle = nullptr;
+        const Chip8RecompiledRom* m_rom = nullptr;
+        Chip8RecompiledContext m_context {};
+        bool m_entries[MemoryManager::CODE_SPACE_SIZE] {};
+        bool m_active = false;
+    };
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include <cstdint>
+
+/**
+ * Plain C interface between the interpreter and ROMs translated to C++
+ * by chip8_recompile. It only depends on the standard headers so the
+ * generated source can be built as a plugin on its own.
+ */
+extern "C" {
+#define CHIP8_RECOMPILED_ABI_VERSION 3
+#define CHIP8_RECOMPILED_SYMBOL "chip8_recompiled_rom"
+
+/**
+ * Pointers straight into the Cpu and memory, the generated code works on
+ * the interpreter's own state so either side can take over at any
+ * instruction boundary. The program counter only has to be current when
+ * a callback is made or run returns.
+ */
+struct Chip8RecompiledContext {
+    uint8_t* registers;
+    uint16_t* address_register;
+    uint16_t* program_counter;
+    uint16_t* stack;
+    uint8_t* sp;
+    const uint8_t* delay_timer;
+    const uint8_t* memory;
+    // cleared by everything but register and I updates, see the idle loop check
+    bool* idle_pure;
+    // set when a write hit one of the recompiled instructions
+    const bool* code_written;
+    void* cpu;
+    // runs one instruction through the interpreter, the program counter
+    // already points behind it, returns non zero when run has to return
+    int (*execute)(void* cpu, uint16_t opcode);
+    // called on backward jumps, non zero when run has to return
+    int (*idle_check)(void* cpu, uint16_t jump_address);
+};
+
+struct Chip8RecompiledRom {
+    uint32_t abi_version;
+    // the Chip8::QuirkProfile the instructions were translated for
+    uint32_t quirks;
+    // the ROM as it is loaded at 0x200, the interpreter compares the
+    // recompiled instructions against memory before using them
+    const uint8_t* image;
+    uint32_t image_size;
+    // addresses run can be entered at, one per recompiled instruction
+    const uint16_t* addresses;
+    uint32_t address_count;
+    // executes up to cycles instructions starting at the program counter
+    // and returns how many were left, returns right away when the program
+    // counter isn't one of the addresses
+    uint64_t (*run)(Chip8RecompiledContext* context, uint64_t cycles);
+};
+
+typedef const Chip8RecompiledRom* (*Chip8RecompiledEntry)();
+}
@@ -0,0 +1,263 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Rewind.h"
+#include <cstring>
+
+using Common::u64;
+
+static void put_varint(std::vector<uint8_t>& out, u64 value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80u));
+        value >>= 7u;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static u64 get_varint(const uint8_t*& in)
+{
+    u64 value = 0;
+    unsigned int shift = 0;
+    while (*in & 0x80u) {
+        value |= static_cast<u64>(*in++ & 0x7Fu) << shift;
+        shift += 7;
+    }
+    value |= static_cast<u64>(*in++) << shift;
+    return value;
+}
+
+/**
+ * Encodes data ^ reference as alternating runs: a varint count of zero
+ * bytes, a varint count of literal bytes, then the literal bytes.
+ */
+static void put_xor_rle(std::vector<uint8_t>& out, const uint8_t* data, const uint8_t* reference, size_t size)
+{
+    size_t position = 0;
+    while (position < size) {
+        size_t zeros = position;
+        while (zeros + sizeof(u64) <= size && memcmp(data + zeros, reference + zeros, sizeof(u64)) == 0) {
+            zeros += sizeof(u64);
+        }
+        while (zeros < size && data[zeros] == reference[zeros]) {
+            zeros++;
+        }
+        size_t literals = zeros;
+        while (literals < size && data[literals] != reference[literals]) {
+            literals++;
+        }
+        put_varint(out, zeros - position);
+        put_varint(out, literals - zeros);
+        for (size_t i = zeros; i < literals; i++) {
+            out.push_back(data[i] ^ reference[i]);
+        }
+        position = literals;
+    }
+}
+
+static void get_xor_rle(const uint8_t*& in, uint8_t* data, const uint8_t* reference, size_t size)
+{
+    size_t position = 0;
+    while (position < size) {
+        u64 zeros = get_varint(in);
+        u64 literals = get_varint(in);
+        memcpy(data + position, reference + position, zeros);
+        position += zeros;
+        for (u64 i = 0; i < literals; i++, position++) {
+            data[position] = reference[position] ^ *in++;
+        }
+    }
+}
+
+static const uint8_t* display_bytes(const Chip8::MachineState& state)
+{
+    return reinterpret_cast<const uint8_t*>(state.display);
+}
+
+// the memory above memory_size isn't part of the state and not copied
+static void copy_state(const Chip8::MachineState& from, Chip8::MachineState& to)
+{
+    to.cpu = from.cpu;
+    to.memory_size = from.memory_size;
+    memcpy(to.memory, from.memory, from.memory_size);
+    memcpy(to.display, from.display, sizeof(from.display));
+    to.hires = from.hires;
+    to.planes = from.planes;
+}
+
+Chip8::RewindBuffer::RewindBuffer(u64 capacity, unsigned int keyframe_interval)
+    : m_buffer(capacity)
+    , m_keyframe_interval(keyframe_interval > 0 ? keyframe_interval : 1)
+    , m_keyframe(std::make_unique<MachineState>())
+    , m_decoded_keyframe(std::make_unique<MachineState>())
+{
+    m_scratch.reserve(sizeof(MachineState) * 2);
+}
+
+void Chip8::RewindBuffer::push(const MachineState& state)
+{
+    // deltas only XOR memory_size bytes, so the size can't change in between
+    bool keyframe = m_records.empty() || m_frames_since_keyframe >= m_keyframe_interval || state.memory_size != m_keyframe->memory_size;
+    encode(state, keyframe ? nullptr : m_keyframe.get());
+    if (m_scratch.size() > m_buffer.size()) {
+        // keeping older frames would make the next pop skip this one
+        clear();
+        return;
+    }
+
+    u64 offset = reserve(m_scratch.size());
+    // making room may have dropped the keyframe this delta refers to
+    if (!keyframe && m_records.empty()) {
+        keyframe = true;
+        encode(state, nullptr);
+        if (m_scratch.size() > m_buffer.size()) {
+            clear();
+            return;
+        }
+        offset = reserve(m_scratch.size());
+    }
+    memcpy(m_buffer.data() + offset, m_scratch.data(), m_scratch.size());
+    m_records.push_back({ offset, m_scratch.size(), keyframe });
+    m_used += m_scratch.size();
+    m_head = offset + m_scratch.size();
+
+    if (keyframe) {
+        copy_state(state, *m_keyframe);
+        m_frames_since_keyframe = 0;
+    }
+    ++m_frames_since_keyframe;
+}
+
+/**
+ * Removes the newest frame and writes it to state. The next push after a
+ * pop always starts a new keyframe.
+ */
+bool Chip8::RewindBuffer::pop(MachineState& state)
+{
+    if (m_records.empty()) {
+        return false;
+    }
+    Record record = m_records.back();
+    if (record.keyframe) {
+        decode(record, nullptr, state);
+    } else {
+        auto keyframe = m_records.rbegin();
+        while (!keyframe->keyframe) {
+            ++keyframe;
+        }
+        decode(*keyframe, nullptr, *m_decoded_keyframe);
+        decode(record, m_decoded_keyframe.get(), state);
+    }
+    m_records.pop_back();
+    m_used -= record.size;
+    m_head = record.offset;
+    m_frames_since_keyframe = m_keyframe_interval;
+    return true;
+}
+
+void Chip8::RewindBuffer::clear()
+{
+    m_records.clear();
+    m_head = 0;
+    m_used = 0;
+    m_frames_since_keyframe = 0;
+}
+
+size_t Chip8::RewindBuffer::get_frame_count() const
+{
+    return m_records.size();
+}
+
+u64 Chip8::RewindBuffer::get_used_bytes() const
+{
+    return m_used;
+}
+
+void Chip8::RewindBuffer::encode(const MachineState& state, const MachineState* reference)
+{
+    static const MachineState zero_state {};
+    if (reference == nullptr) {
+        reference = &zero_state;
+    }
+    m_scratch.clear();
+    const auto* cpu = reinterpret_cast<const uint8_t*>(&state.cpu);
+    m_scratch.insert(m_scratch.end(), cpu, cpu + sizeof(state.cpu));
+    const auto* memory_size = reinterpret_cast<const uint8_t*>(&state.memory_size);
+    m_scratch.insert(m_scratch.end(), memory_size, memory_size + sizeof(state.memory_size));
+    put_xor_rle(m_scratch, state.memory, reference->memory, state.memory_size);
+    m_scratch.push_back(state.hires ? 1 : 0);
+    m_scratch.push_back(state.planes);
+    put_xor_rle(m_scratch, display_bytes(state), display_bytes(*reference), sizeof(state.display));
+}
+
+void Chip8::RewindBuffer::decode(const Record& record, const MachineState* reference, MachineState& state) const
+{
+    static const MachineState zero_state {};
+    if (reference == nullptr) {
+        reference = &zero_state;
+    }
+    const uint8_t* in = m_buffer.data() + record.offset;
+    memcpy(&state.cpu, in, sizeof(state.cpu));
+    in += sizeof(state.cpu);
+    memcpy(&state.memory_size, in, sizeof(state.memory_size));
+    in += sizeof(state.memory_size);
+    get_xor_rle(in, state.memory, reference->memory, state.memory_size);
+    state.hires = *in++ != 0;
+    state.planes = *in++;
+    get_xor_rle(in, reinterpret_cast<uint8_t*>(state.display), display_bytes(*reference), sizeof(state.display));
+}
+
+/**
+ * Finds room for size contiguous bytes at the write position, wrapping to
+ * the start of the ring and evicting the oldest segments as needed. The
+ * records at or above the write position are always the oldest ones, when
+ * wrapping they go first, whether they overlap the new record or not, so
+ * the ring stays in the order it was written.
+ */
+u64 Chip8::RewindBuffer::reserve(u64 size)
+{
+    u64 offset = m_head;
+    if (offset + size > m_buffer.size()) {
+        offset = 0;
+        while (!m_records.empty() && m_records.front().offset >= m_head) {
+            evict_oldest_segment();
+        }
+    }
+    while (!m_records.empty()) {
+        const Record& oldest = m_records.front();
+        bool overlaps = oldest.offset < offset + size && offset < oldest.offset + oldest.size;
+        if (!overlaps) {
+            break;
+        }
+        evict_oldest_segment();
+    }
+    return offset;
+}
+
+void Chip8::RewindBuffer::evict_oldest_segment()
+{
+    do {
+        m_used -= m_records.front().size;
+        m_records.pop_front();
+    } while (!m_records.empty() && !m_records.front().keyframe);
+}
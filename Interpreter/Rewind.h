@@ -0,0 +1,77 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "Machine.h"
+#include <Types.h>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace Chip8 {
+    /**
+     * Fixed size history of machine states for stepping a session
+     * backwards. Every keyframe_interval frames a keyframe is stored, the
+     * frames in between only store the Cpu state plus the XOR of memory
+     * and display against that keyframe, run length encoded. Keyframes are
+     * encoded the same way against an all zero state.
+     *
+     * Records live in one preallocated byte ring, when it is full the
+     * oldest keyframe is dropped together with all frames depending on it.
+     */
+    class RewindBuffer final {
+    public:
+        explicit RewindBuffer(Common::u64 capacity = DEFAULT_CAPACITY, unsigned int keyframe_interval = DEFAULT_KEYFRAME_INTERVAL);
+        void push(const MachineState& state);
+        bool pop(MachineState& state);
+        void clear();
+        size_t get_frame_count() const;
+        Common::u64 get_used_bytes() const;
+
+        static constexpr Common::u64 DEFAULT_CAPACITY = 1 << 20;
+        static constexpr unsigned int DEFAULT_KEYFRAME_INTERVAL = 60;
+
+    private:
+        struct Record {
+            Common::u64 offset;
+            Common::u64 size;
+            bool keyframe;
+        };
+
+        void encode(const MachineState& state, const MachineState* reference);
+        void decode(const Record& record, const MachineState* reference, MachineState& state) const;
+        Common::u64 reserve(Common::u64 size);
+        void evict_oldest_segment();
+
+    private:
+        std::vector<uint8_t> m_buffer;
+        std::deque<Record> m_records;
+        unsigned int m_keyframe_interval;
+        unsigned int m_frames_since_keyframe = 0;
+        Common::u64 m_head = 0;
+        Common::u64 m_used = 0;
+        std::vector<uint8_t> m_scratch;
+        std::unique_ptr<MachineState> m_keyframe;
+        std::unique_ptr<MachineState> m_decoded_keyframe;
+    };
+}
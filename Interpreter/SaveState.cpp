@@ -0,0 +1,108 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "SaveState.h"
+#include "ByteStream.h"
+#include <cstring>
+
+static const uint8_t STATE_MAGIC[4] = { 'C', '8', 'S', 'T' };
+
+void Chip8::encode_state(const MachineState& state, std::vector<uint8_t>& blob)
+{
+    blob.clear();
+    blob.reserve(sizeof(MachineState) - sizeof(state.memory) + state.memory_size);
+    Writer writer(blob);
+    writer.put_bytes(STATE_MAGIC, sizeof(STATE_MAGIC));
+    writer.put(STATE_VERSION);
+
+    const CpuState& cpu = state.cpu;
+    writer.put_bytes(cpu.registers, sizeof(cpu.registers));
+    writer.put(cpu.address_register);
+    writer.put(cpu.program_counter);
+    for (uint16_t entry : cpu.stack) {
+        writer.put(entry);
+    }
+    writer.put(cpu.sp);
+    writer.put(cpu.delay_timer);
+    writer.put(cpu.sound_timer);
+    writer.put(cpu.keypad);
+    writer.put_bytes(cpu.audio_pattern, sizeof(cpu.audio_pattern));
+    writer.put(cpu.pitch);
+    writer.put(cpu.frame_cycle);
+    writer.put(cpu.cycle_count);
+    writer.put(cpu.frame_count);
+    writer.put(cpu.random_state);
+    writer.put(static_cast<uint8_t>(cpu.quirks));
+    writer.put(cpu.cycles_per_frame);
+
+    writer.put(state.memory_size);
+    writer.put_bytes(state.memory, state.memory_size);
+    writer.put(static_cast<uint8_t>(state.hires ? 1 : 0));
+    writer.put(state.planes);
+    for (uint64_t row : state.display) {
+        writer.put(row);
+    }
+}
+
+bool Chip8::decode_state(const std::vector<uint8_t>& blob, MachineState& state)
+{
+    Reader reader(blob);
+    uint8_t magic[sizeof(STATE_MAGIC)];
+    reader.get_bytes(magic, sizeof(magic));
+    if (memcmp(magic, STATE_MAGIC, sizeof(magic)) != 0 || reader.get<uint16_t>() != STATE_VERSION) {
+        return false;
+    }
+
+    CpuState& cpu = state.cpu;
+    reader.get_bytes(cpu.registers, sizeof(cpu.registers));
+    cpu.address_register = reader.get<uint16_t>();
+    cpu.program_counter = reader.get<uint16_t>();
+    for (uint16_t& entry : cpu.stack) {
+        entry = reader.get<uint16_t>();
+    }
+    cpu.sp = reader.get<uint8_t>();
+    cpu.delay_timer = reader.get<uint8_t>();
+    cpu.sound_timer = reader.get<uint8_t>();
+    cpu.keypad = reader.get<uint16_t>();
+    reader.get_bytes(cpu.audio_pattern, sizeof(cpu.audio_pattern));
+    cpu.pitch = reader.get<uint8_t>();
+    cpu.frame_cycle = reader.get<uint32_t>();
+    cpu.cycle_count = reader.get<u64>();
+    cpu.frame_count = reader.get<u64>();
+    cpu.random_state = reader.get<u64>();
+    cpu.quirks = static_cast<QuirkProfile>(reader.get<uint8_t>());
+    cpu.cycles_per_frame = reader.get<uint32_t>();
+
+    // 4 KB, or all 64 KB for XO-CHIP programs
+    state.memory_size = reader.get<uint32_t>();
+    if (state.memory_size != MemoryManager::CODE_SPACE_SIZE && state.memory_size != MemoryManager::MEMORY_SIZE) {
+        return false;
+    }
+    reader.get_bytes(state.memory, state.memory_size);
+    state.hires = reader.get<uint8_t>() != 0;
+    state.planes = reader.get<uint8_t>();
+    for (uint64_t& row : state.display) {
+        row = reader.get<uint64_t>();
+    }
+    return reader.ok() && cpu.sp <= std::size(cpu.stack);
+}
@@ -24,18 +24,144 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 #include "Chip8.h"
+#include "Headless.h"
 #include <Common.h>
 #include <Print.h>
+#include <Types.h>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+
+struct Options {
+    Chip8::CpuCore core = Chip8::Cpu::default_core();
+    bool headless = false;
+    Common::u64 cycles = 100000000;
+    unsigned int cycles_per_frame = Chip8::DEFAULT_CYCLES_PER_FRAME;
+    bool fusion = true;
+    bool has_quirks = false;
+    Chip8::QuirkProfile quirks = Chip8::QuirkProfile::Modern;
+    bool has_seed = false;
+    Common::u64 seed = Chip8::DEFAULT_SEED;
+    std::string load_state_file;
+    std::string save_state_file;
+    std::string record_file;
+    std::string replay_file;
+    std::string recompiled_file;
+    std::string wav_file;
+    std::string source_file;
+};
+
+static bool parse_options(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--core" && has_value) {
+            if (!Chip8::parse_core(argv[++i], options.core)) {
+                Common::err("Unknown core: ", argv[i]);
+                return false;
+            }
+        } else if (arg == "--quirks" && has_value) {
+            if (!Chip8::parse_quirks(argv[++i], options.quirks)) {
+                Common::err("Unknown quirk profile: ", argv[i]);
+                return false;
+            }
+            options.has_quirks = true;
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--no-fusion") {
+            options.fusion = false;
+        } else if (arg == "--cycles" && has_value) {
+            options.cycles = Common::parse_unsigned(argv[++i]);
+        } else if (arg == "--ipf" && has_value) {
+            options.cycles_per_frame = Common::parse_unsigned(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            options.seed = Common::parse_unsigned(argv[++i], 0);
+            options.has_seed = true;
+        } else if (arg == "--record" && has_value) {
+            options.record_file = argv[++i];
+        } else if (arg == "--replay" && has_value) {
+            options.replay_file = argv[++i];
+        } else if (arg == "--recompiled" && has_value) {
+            options.recompiled_file = argv[++i];
+        } else if (arg == "--wav" && has_value) {
+            options.wav_file = argv[++i];
+        } else if (arg == "--load-state" && has_value) {
+            options.load_state_file = argv[++i];
+        } else if (arg == "--save-state" && has_value) {
+            options.save_state_file = argv[++i];
+        } else if (arg == "--ips" && has_value) {
+            // frames are a fixed 60th of a second, so this is rounded to
+            // the nearest whole number of instructions per frame
+            Common::u64 ips = Common::parse_unsigned(argv[++i]);
+            if (ips < Chip8::FRAMES_PER_SECOND) {
+                Common::err("--ips has to be at least ", Chip8::FRAMES_PER_SECOND, ", one instruction per frame");
+                return false;
+            }
+            options.cycles_per_frame = (ips + Chip8::FRAMES_PER_SECOND / 2) / Chip8::FRAMES_PER_SECOND;
+        } else if (arg.rfind("--", 0) != 0 && options.source_file.empty()) {
+            options.source_file = arg;
+        } else {
+            return false;
+        }
+    }
+    if (options.headless && !options.record_file.empty()) {
+        Common::err("--record needs the window, there is no input to record with --headless\n");
+        return false;
+    }
+    if (!options.has_quirks) {
+        options.quirks = Chip8::quirks_for_file(options.source_file);
+    }
+    return !options.source_file.empty();
+}
 
 int main(int argc, char **argv)
 {
-    if (argc != 2) {
-        Common::err("Usage: ./chip8 <SOURCE_FILE>\n");
+    Options options;
+    bool parsed = false;
+    try {
+        parsed = parse_options(argc, argv, options);
+    } catch (const std::logic_error&) {
+        // Common::parse_unsigned throws on anything that isn't a number, negative ones included
+    }
+    if (!parsed) {
+        Common::err("Usage: ./chip8 [--core table|switch|threaded|jit] [--quirks modern|chip8|schip|xochip] [--headless] [--no-fusion] [--cycles N] [--ipf N | --ips N] [--seed N] [--record FILE | --replay FILE] [--recompiled PLUGIN] [--wav FILE] [--load-state FILE] [--save-state FILE] <SOURCE_FILE>\n");
         return -1;
     }
-    std::string source_file = argv[1];
+    if (options.headless) {
+        Chip8::HeadlessOptions headless_options {
+            .cycles = options.cycles,
+            .core = options.core,
+            .fusion = options.fusion,
+            .quirks = options.quirks,
+            .cycles_per_frame = options.cycles_per_frame,
+            .seed = options.seed,
+            .load_state_file = options.load_state_file,
+            .save_state_file = options.save_state_file,
+            .replay_file = options.replay_file,
+            .recompiled_file = options.recompiled_file,
+            .wav_file = options.wav_file
+        };
+        return Chip8::run_headless(options.source_file, headless_options);
+    }
     Chip8::Chip8Application application(Graphics::Types::Size(64 * 10, 32 * 10));
-    application.launch(source_file);
+    application.set_cpu_core(options.core);
+    application.set_cycles_per_frame(options.cycles_per_frame);
+    application.set_fusion(options.fusion);
+    application.set_quirks(options.quirks);
+    if (options.has_seed) {
+        application.set_seed(options.seed);
+    }
+    if (!options.record_file.empty()) {
+        application.record_input(options.record_file);
+    }
+    if (!options.replay_file.empty() && !application.replay_input(options.replay_file)) {
+        Common::err("Failed to load input from ", options.replay_file);
+        return -1;
+    }
+    if (!options.recompiled_file.empty()) {
+        application.use_recompiled(options.recompiled_file);
+    }
+    application.launch(options.source_file);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "FramePacer.h"
+#include <thread>
+
+Common::FramePacer::FramePacer(Clock::duration frame_duration)
+    : m_frame_duration(frame_duration)
+{
+    reset();
+}
+
+void Common::FramePacer::reset()
+{
+    m_next_deadline = Clock::now() + m_frame_duration;
+}
+
+void Common::FramePacer::wait_for_next_frame()
+{
+    auto now = Clock::now();
+    if (now - m_next_deadline > m_frame_duration * MAX_FRAMES_BEHIND) {
+        m_next_deadline = now + m_frame_duration;
+        return;
+    }
+
+    auto remaining = m_next_deadline - now;
+    if (remaining > SPIN_THRESHOLD) {
+        std::this_thread::sleep_for(remaining - SPIN_THRESHOLD);
+    }
+    while (Clock::now() < m_next_deadline) {
+        std::this_thread::yield();
+    }
+    m_next_deadline += m_frame_duration;
+}
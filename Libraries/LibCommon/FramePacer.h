@@ -0,0 +1,52 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include <chrono>
+
+namespace Common {
+    /**
+     * Keeps a loop running at a fixed frame rate. Deadlines are absolute
+     * (start + n * frame duration) so oversleeping in one frame is made up
+     * for in the next one instead of accumulating drift.
+     */
+    class FramePacer final {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit FramePacer(Clock::duration frame_duration);
+        void wait_for_next_frame();
+        void reset();
+
+    private:
+        // sleeps can overshoot by a few hundred microseconds, the last part
+        // of the wait is spent spinning on the clock
+        static constexpr auto SPIN_THRESHOLD = std::chrono::microseconds(500);
+        // when the loop falls further behind than this it gives up on
+        // catching up and starts counting from now again
+        static constexpr int MAX_FRAMES_BEHIND = 5;
+
+        Clock::duration m_frame_duration;
+        Clock::time_point m_next_deadline;
+    };
+}
@@ -33,8 +33,8 @@ namespace Common {
 
     template<typename First, typename ...T>
     void msg(First f, T ...args) {
-        msg(f);
-        msg(args...);
+        std::cout << f;
+        ((std::cout << args), ...);
         std::cout << '\n' << std::flush;
     }
 
@@ -45,8 +45,8 @@ namespace Common {
 
     template<typename First, typename ...T>
     void err(First f, T ...args) {
-        err(f);
-        err(args...);
+        std::cerr << f;
+        ((std::cerr << args), ...);
         std::cerr << '\n' << std::flush;
     }
 }
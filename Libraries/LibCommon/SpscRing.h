@@ -0,0 +1,88 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "Types.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace Common {
+    /**
+     * Bounded lock-free queue between exactly one producer and one consumer
+     * thread. Neither side ever waits, push fails when the ring is full and
+     * pop when it is empty. Capacity has to be a power of two.
+     */
+    template<typename T, size_t Capacity>
+    class SpscRing final {
+        static_assert((Capacity & (Capacity - 1)) == 0, "capacity has to be a power of two");
+
+    public:
+        bool push(const T& value)
+        {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            if (head - m_cached_tail == Capacity) {
+                m_cached_tail = m_tail.load(std::memory_order_acquire);
+                if (head - m_cached_tail == Capacity) {
+                    return false;
+                }
+            }
+            m_slots[head & (Capacity - 1)] = value;
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T& value)
+        {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail == m_cached_head) {
+                m_cached_head = m_head.load(std::memory_order_acquire);
+                if (tail == m_cached_head) {
+                    return false;
+                }
+            }
+            value = m_slots[tail & (Capacity - 1)];
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Only exact when called from one of the two sides while the other
+         * one is idle, otherwise it is a snapshot.
+         */
+        size_t size() const
+        {
+            return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        // the producer and the consumer each keep a copy of the other
+        // side's index next to their own so they only touch the shared
+        // line when the copy says the ring is full or empty
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head { 0 };
+        size_t m_cached_tail = 0;
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail { 0 };
+        size_t m_cached_head = 0;
+        alignas(CACHE_LINE_SIZE) std::array<T, Capacity> m_slots {};
+    };
+}
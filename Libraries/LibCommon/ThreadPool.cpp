@@ -0,0 +1,124 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "ThreadPool.h"
+
+Common::ThreadPool::ThreadPool(unsigned int thread_count)
+{
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+    for (unsigned int i = 0; i < thread_count; i++) {
+        m_queues.emplace_back(std::make_unique<WorkerQueue>());
+    }
+    for (unsigned int i = 0; i < thread_count; i++) {
+        m_threads.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+Common::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_work_available.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void Common::ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_unfinished;
+        WorkerQueue& queue = *m_queues[m_next_queue];
+        m_next_queue = (m_next_queue + 1) % m_queues.size();
+        std::lock_guard<std::mutex> queue_lock(queue.mutex);
+        queue.tasks.emplace_back(std::move(task));
+        ++m_queued;
+    }
+    m_work_available.notify_one();
+}
+
+void Common::ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_all_done.wait(lock, [this] { return m_unfinished == 0; });
+}
+
+unsigned int Common::ThreadPool::get_thread_count() const
+{
+    return m_threads.size();
+}
+
+void Common::ThreadPool::worker_loop(unsigned int index)
+{
+    std::function<void()> task;
+    while (true) {
+        if (pop_local(index, task) || steal(index, task)) {
+            task();
+            task = nullptr;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_unfinished == 0) {
+                m_all_done.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_work_available.wait(lock, [this] { return m_stopping || m_queued > 0; });
+        if (m_stopping && m_queued == 0) {
+            return;
+        }
+    }
+}
+
+bool Common::ThreadPool::pop_local(unsigned int index, std::function<void()>& task)
+{
+    WorkerQueue& queue = *m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    --m_queued;
+    return true;
+}
+
+bool Common::ThreadPool::steal(unsigned int index, std::function<void()>& task)
+{
+    for (size_t offset = 1; offset < m_queues.size(); offset++) {
+        WorkerQueue& queue = *m_queues[(index + offset) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        --m_queued;
+        return true;
+    }
+    return false;
+}
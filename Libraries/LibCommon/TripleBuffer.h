@@ -0,0 +1,86 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "Types.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace Common {
+    /**
+     * Hands complete values from one producer thread to one consumer
+     * thread without either of them waiting. The producer fills the back
+     * slot and swaps it with the middle one, the consumer swaps its front
+     * slot with the middle one when that holds something new. Neither side
+     * ever sees a slot the other one is working on, and the consumer always
+     * gets the newest published value, older ones are skipped.
+     */
+    template<typename T>
+    class TripleBuffer final {
+    public:
+        explicit TripleBuffer(const T& initial = T {})
+            : m_slots { initial, initial, initial }
+        {
+        }
+
+        // producer side
+        T& back()
+        {
+            return m_slots[m_back];
+        }
+
+        void publish()
+        {
+            uint8_t previous = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel);
+            m_back = previous & INDEX_MASK;
+        }
+
+        // consumer side, returns whether front() changed
+        bool update()
+        {
+            if (!(m_middle.load(std::memory_order_relaxed) & FRESH)) {
+                return false;
+            }
+            uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+            m_front = previous & INDEX_MASK;
+            return true;
+        }
+
+        const T& front() const
+        {
+            return m_slots[m_front];
+        }
+
+    private:
+        // set on the middle index while it holds a value the consumer
+        // hasn't taken yet
+        static constexpr uint8_t FRESH = 4;
+        static constexpr uint8_t INDEX_MASK = 3;
+
+        std::array<T, 3> m_slots;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint8_t> m_middle { 1 };
+        alignas(CACHE_LINE_SIZE) uint8_t m_back = 0;
+        alignas(CACHE_LINE_SIZE) uint8_t m_front = 2;
+    };
+}
@@ -21,4 +21,17 @@
 // CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
 // OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
-#include "Types.h"
\ No newline at end of file
+#include "Types.h"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+Common::u64 Common::parse_unsigned(const std::string& text, int base)
+{
+    // std::stoull skips leading white space as well
+    auto first = std::find_if_not(text.begin(), text.end(), [](unsigned char c) { return std::isspace(c); });
+    if (first != text.end() && *first == '-') {
+        throw std::invalid_argument(text);
+    }
+    return std::stoull(text, nullptr, base);
+}
@@ -35,6 +35,9 @@ namespace Common {
     constexpr int EXIT_FAIL = -1;
     constexpr int EXIT_SUCC = 0;
 
+    // used to keep data written by different threads on separate cache lines
+    constexpr u64 CACHE_LINE_SIZE = 64;
+
     template<typename T>
     inline std::string int_to_hex(T i)
     {
@@ -45,6 +48,12 @@ namespace Common {
         return stream.str();
     }
 
+    /**
+     * std::stoull for command line values, except that "-1" throws
+     * std::invalid_argument instead of wrapping around to 2^64 - 1.
+     */
+    u64 parse_unsigned(const std::string& text, int base = 10);
+
     template<typename Type>
     class Tuple final {
     public:
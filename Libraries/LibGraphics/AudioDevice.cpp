@@ -0,0 +1,73 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "AudioDevice.h"
+#include <iostream>
+
+Graphics::AudioDevice::AudioDevice(int sample_rate, Callback callback, void* user_data)
+    : m_callback(callback)
+    , m_user_data(user_data)
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        std::cerr << "SDL audio init error: " << SDL_GetError() << std::endl;
+        return;
+    }
+    SDL_AudioSpec wanted {};
+    wanted.freq = sample_rate;
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = BUFFER_SAMPLES;
+    wanted.callback = fill;
+    wanted.userdata = this;
+    m_device = SDL_OpenAudioDevice(nullptr, 0, &wanted, nullptr, 0);
+    if (m_device == 0) {
+        std::cerr << "SDL failed to open audio device: " << SDL_GetError() << std::endl;
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+}
+
+Graphics::AudioDevice::~AudioDevice()
+{
+    if (m_device != 0) {
+        SDL_CloseAudioDevice(m_device);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+}
+
+bool Graphics::AudioDevice::is_open() const
+{
+    return m_device != 0;
+}
+
+void Graphics::AudioDevice::set_paused(bool paused)
+{
+    if (m_device != 0) {
+        SDL_PauseAudioDevice(m_device, paused ? 1 : 0);
+    }
+}
+
+void Graphics::AudioDevice::fill(void* user_data, Uint8* stream, int length)
+{
+    auto* device = static_cast<AudioDevice*>(user_data);
+    device->m_callback(device->m_user_data, reinterpret_cast<int16_t*>(stream), length / static_cast<int>(sizeof(int16_t)));
+}
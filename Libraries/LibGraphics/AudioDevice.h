@@ -0,0 +1,57 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include <SDL2/SDL.h>
+#include <cstdint>
+
+namespace Graphics {
+    /**
+     * Mono 16 bit output. SDL calls the callback from its own audio thread
+     * whenever the device needs more samples, so the callback must never
+     * block. Failing to open a device is not fatal, everything keeps
+     * running without sound. The device starts paused.
+     */
+    class AudioDevice final {
+    public:
+        using Callback = void (*)(void* user_data, int16_t* samples, int count);
+
+        AudioDevice(int sample_rate, Callback callback, void* user_data);
+        ~AudioDevice();
+        AudioDevice(const AudioDevice&) = delete;
+        AudioDevice& operator=(const AudioDevice&) = delete;
+
+        bool is_open() const;
+        void set_paused(bool paused);
+
+    private:
+        static void fill(void* user_data, Uint8* stream, int length);
+
+        // about 10 ms at 48 kHz
+        static constexpr Uint16 BUFFER_SAMPLES = 512;
+
+        SDL_AudioDeviceID m_device = 0;
+        Callback m_callback;
+        void* m_user_data;
+    };
+}
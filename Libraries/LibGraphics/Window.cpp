@@ -22,7 +22,9 @@
 // OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Window.h"
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 
 Graphics::Window::Window(Graphics::Types::Size size, std::string title)
     : m_size(size)
@@ -37,7 +39,7 @@ Graphics::Window::Window(Graphics::Types::Size size, std::string title)
     m_painter = initialize_painter(m_renderer, m_clear_color);
 }
 
-Graphics::Window::Window(Graphics::Types::Size size, Graphics::Types::Size texture_size, std::string title)
+Graphics::Window::Window(Graphics::Types::Size size, Graphics::Types::Size texture_size, std::string title, bool vsync)
     : m_size(size)
 {
     init();
@@ -46,7 +48,7 @@ Graphics::Window::Window(Graphics::Types::Size size, Graphics::Types::Size textu
     m_screen_height = screen_info.get_second();
     Graphics::Types::Point position(m_screen_width / 2 - size.get_first() / 2, m_screen_height / 2 - size.get_second() / 2);
     m_window = create_window(position, size, std::move(title));
-    m_renderer = create_renderer(m_window);
+    m_renderer = create_renderer(m_window, vsync);
     m_painter = initialize_painter(m_renderer, m_clear_color);
     m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, texture_size.get_first(), texture_size.get_second());
 }
@@ -77,9 +79,13 @@ SDL_Window* Graphics::Window::create_window(Graphics::Types::Point position, Gra
     return win;
 }
 
-SDL_Renderer* Graphics::Window::create_renderer(SDL_Window* window)
+SDL_Renderer* Graphics::Window::create_renderer(SDL_Window* window, bool vsync)
 {
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, 0, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    Uint32 flags = SDL_RENDERER_ACCELERATED;
+    if (vsync) {
+        flags |= SDL_RENDERER_PRESENTVSYNC;
+    }
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, 0, flags);
     if (renderer == nullptr) {
         std::cerr << "SDL failed to create renderer: " << SDL_GetError() << std::endl;
         throw std::runtime_error("Failed to create sdl renderer!");
@@ -160,6 +166,14 @@ bool Graphics::Window::update_hook()
     return false;
 }
 
+/**
+ * handle_key gets every key press and release process_input doesn't map
+ * onto the keypad itself.
+ */
+void Graphics::Window::handle_key(SDL_Keycode, bool)
+{
+}
+
 int Graphics::Window::get_window_width()
 {
     return m_size.get_first();
@@ -178,198 +192,46 @@ void Graphics::Window::update_texture(void const* buffer, int pitch)
     SDL_RenderPresent(m_renderer);
 }
 
-bool Graphics::Window::process_input(uint8_t *keys)
+// the left four columns of a QWERTY keyboard in the layout of the COSMAC
+// VIP keypad, indexed by the key they stand for
+static constexpr SDL_Keycode KEY_MAP[16] = {
+    SDLK_x, SDLK_1, SDLK_2, SDLK_3,
+    SDLK_q, SDLK_w, SDLK_e, SDLK_a,
+    SDLK_s, SDLK_d, SDLK_z, SDLK_c,
+    SDLK_4, SDLK_r, SDLK_f, SDLK_v
+};
+
+/**
+ * Drains the SDL event queue and folds the key changes into keys, one
+ * bit per keypad key. Meant to be called once per frame.
+ */
+bool Graphics::Window::process_input(uint16_t& keys)
 {
     bool quit = false;
 
     SDL_Event event;
 
-    while (SDL_PollEvent(&event))
-    {
-        switch (event.type)
-        {
-        case SDL_QUIT:
-        {
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT) {
             quit = true;
-        } break;
-
-        case SDL_KEYDOWN:
-        {
-            switch (event.key.keysym.sym)
-            {
-            case SDLK_ESCAPE:
-            {
-                quit = true;
-            } break;
-
-            case SDLK_x:
-            {
-                keys[0] = 1;
-            } break;
-
-            case SDLK_1:
-            {
-                keys[1] = 1;
-            } break;
-
-            case SDLK_2:
-            {
-                keys[2] = 1;
-            } break;
-
-            case SDLK_3:
-            {
-                keys[3] = 1;
-            } break;
-
-            case SDLK_q:
-            {
-                keys[4] = 1;
-            } break;
-
-            case SDLK_w:
-            {
-                keys[5] = 1;
-            } break;
-
-            case SDLK_e:
-            {
-                keys[6] = 1;
-            } break;
-
-            case SDLK_a:
-            {
-                keys[7] = 1;
-            } break;
-
-            case SDLK_s:
-            {
-                keys[8] = 1;
-            } break;
-
-            case SDLK_d:
-            {
-                keys[9] = 1;
-            } break;
-
-            case SDLK_z:
-            {
-                keys[0xA] = 1;
-            } break;
-
-            case SDLK_c:
-            {
-                keys[0xB] = 1;
-            } break;
-
-            case SDLK_4:
-            {
-                keys[0xC] = 1;
-            } break;
-
-            case SDLK_r:
-            {
-                keys[0xD] = 1;
-            } break;
-
-            case SDLK_f:
-            {
-                keys[0xE] = 1;
-            } break;
-
-            case SDLK_v:
-            {
-                keys[0xF] = 1;
-            } break;
-            }
-        } break;
-
-        case SDL_KEYUP:
-        {
-            switch (event.key.keysym.sym)
-            {
-            case SDLK_x:
-            {
-                keys[0] = 0;
-            } break;
-
-            case SDLK_1:
-            {
-                keys[1] = 0;
-            } break;
-
-            case SDLK_2:
-            {
-                keys[2] = 0;
-            } break;
-
-            case SDLK_3:
-            {
-                keys[3] = 0;
-            } break;
-
-            case SDLK_q:
-            {
-                keys[4] = 0;
-            } break;
-
-            case SDLK_w:
-            {
-                keys[5] = 0;
-            } break;
-
-            case SDLK_e:
-            {
-                keys[6] = 0;
-            } break;
-
-            case SDLK_a:
-            {
-                keys[7] = 0;
-            } break;
-
-            case SDLK_s:
-            {
-                keys[8] = 0;
-            } break;
-
-            case SDLK_d:
-            {
-                keys[9] = 0;
-            } break;
-
-            case SDLK_z:
-            {
-                keys[0xA] = 0;
-            } break;
-
-            case SDLK_c:
-            {
-                keys[0xB] = 0;
-            } break;
-
-            case SDLK_4:
-            {
-                keys[0xC] = 0;
-            } break;
-
-            case SDLK_r:
-            {
-                keys[0xD] = 0;
-            } break;
-
-            case SDLK_f:
-            {
-                keys[0xE] = 0;
-            } break;
-
-            case SDLK_v:
-            {
-                keys[0xF] = 0;
-            } break;
-            }
-        } break;
+            continue;
+        }
+        if (event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) {
+            continue;
+        }
+        SDL_Keycode key = event.key.keysym.sym;
+        bool pressed = event.type == SDL_KEYDOWN;
+        if (key == SDLK_ESCAPE && pressed) {
+            quit = true;
+            continue;
+        }
+        const SDL_Keycode* mapped = std::find(std::begin(KEY_MAP), std::end(KEY_MAP), key);
+        if (mapped == std::end(KEY_MAP)) {
+            handle_key(key, pressed);
+            continue;
         }
+        uint16_t bit = 1u << (mapped - std::begin(KEY_MAP));
+        keys = pressed ? keys | bit : keys & ~bit;
     }
 
     return quit;
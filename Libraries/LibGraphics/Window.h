@@ -36,7 +36,7 @@ namespace Graphics {
     class Window {
     public:
         Window(Graphics::Types::Size size, std::string title);
-        Window(Graphics::Types::Size size, Graphics::Types::Size texture_size, std::string title);
+        Window(Graphics::Types::Size size, Graphics::Types::Size texture_size, std::string title, bool vsync = true);
         ~Window();
         void run();
         void set_clear_color(Graphics::Types::Color color);
@@ -48,13 +48,14 @@ namespace Graphics {
     protected:
         std::vector<std::shared_ptr<Graphics::Entity>> m_entities;
         virtual bool update_hook();
+        virtual void handle_key(SDL_Keycode key, bool pressed);
         void update_texture(void const* buffer, int pitch);
-        bool process_input(uint8_t *keys);
+        bool process_input(uint16_t& keys);
 
     private:
         static void init();
         static SDL_Window* create_window(Graphics::Types::Point position, Graphics::Types::Size size, std::string title);
-        static SDL_Renderer* create_renderer(SDL_Window* window);
+        static SDL_Renderer* create_renderer(SDL_Window* window, bool vsync = true);
         static Tuple<int> initialize_screen_info();
         static std::shared_ptr<Painter> initialize_painter(SDL_Renderer* renderer, Graphics::Types::Color clear_color);
         void update();
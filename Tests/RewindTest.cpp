@@ -0,0 +1,188 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <Print.h>
+#include <Random.h>
+#include <Rewind.h>
+#include <Types.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using Chip8::MachineState;
+using Chip8::RewindBuffer;
+
+static void mutate(MachineState& state, Chip8::Random& random, unsigned int frame)
+{
+    state.cpu.cycle_count = frame;
+    state.cpu.program_counter = 0x200 + (frame & 0xFFEu);
+    // the address space shrinks for 100 frames out of every 300 and grows
+    // again, which forces a keyframe each time
+    state.memory_size = (frame / 100) % 3 == 1 ? Chip8::MemoryManager::CODE_SPACE_SIZE : Chip8::MemoryManager::MEMORY_SIZE;
+    // anywhere from a handful of bytes to a few kilobytes change, all of
+    // them in the first 16 KB so keyframes stay smaller than the ring
+    unsigned int length = (random.next_byte() << 5u) >> (random.next_byte() & 7u);
+    length = std::min(length, state.memory_size / 2);
+    unsigned int start = (random.next_byte() << 8u | random.next_byte()) % (std::min(16384u, state.memory_size) - length);
+    for (unsigned int i = 0; i < length; i++) {
+        state.memory[start + i] = random.next_byte();
+    }
+    state.display[random.next_byte() % (sizeof(state.display) / sizeof(state.display[0]))] ^= frame;
+    state.hires = frame & 1u;
+}
+
+// the memory above memory_size isn't part of the state
+static bool same_state(const MachineState& a, const MachineState& b)
+{
+    return memcmp(&a.cpu, &b.cpu, sizeof(a.cpu)) == 0
+        && a.memory_size == b.memory_size
+        && memcmp(a.memory, b.memory, a.memory_size) == 0
+        && memcmp(a.display, b.display, sizeof(a.display)) == 0
+        && a.hires == b.hires
+        && a.planes == b.planes;
+}
+
+static bool check_pops(RewindBuffer& rewind, std::vector<std::unique_ptr<MachineState>>& pushed, size_t count, MachineState& scratch)
+{
+    for (size_t i = 0; i < count && rewind.get_frame_count() > 0; i++) {
+        if (!rewind.pop(scratch)) {
+            Common::err("pop failed with ", rewind.get_frame_count(), " frames left");
+            return false;
+        }
+        if (!same_state(scratch, *pushed.back())) {
+            Common::err("popped state differs from frame ", pushed.back()->cpu.cycle_count);
+            return false;
+        }
+        pushed.pop_back();
+    }
+    return true;
+}
+
+/**
+ * Pushes states of very different encoded sizes through a ring small
+ * enough to wrap many times, popping part of the history now and then,
+ * and checks every popped state against the one that was pushed.
+ */
+static bool run(Common::u64 capacity, unsigned int keyframe_interval, Common::u64 seed)
+{
+    RewindBuffer rewind(capacity, keyframe_interval);
+    Chip8::Random random(seed);
+    auto state = std::make_unique<MachineState>();
+    auto scratch = std::make_unique<MachineState>();
+    std::vector<std::unique_ptr<MachineState>> pushed;
+    Common::u64 used = 0;
+    unsigned int evictions = 0;
+    for (unsigned int frame = 1; frame <= 600; frame++) {
+        mutate(*state, random, frame);
+        rewind.push(*state);
+        pushed.push_back(std::make_unique<MachineState>(*state));
+        // only the newest frames are still in the ring, drop the others
+        if (pushed.size() > rewind.get_frame_count()) {
+            pushed.erase(pushed.begin(), pushed.end() - rewind.get_frame_count());
+        }
+        evictions += rewind.get_used_bytes() < used;
+        if (rewind.get_used_bytes() > capacity) {
+            Common::err("used ", rewind.get_used_bytes(), " bytes of ", capacity);
+            return false;
+        }
+        // now and then rewind a little, and every so often all the way
+        uint8_t roll = random.next_byte();
+        size_t pops = roll < 16 ? random.next_byte() % 16 : roll < 20 ? pushed.size() : 0;
+        if (!check_pops(rewind, pushed, pops, *scratch)) {
+            return false;
+        }
+        used = rewind.get_used_bytes();
+    }
+    if (!check_pops(rewind, pushed, pushed.size(), *scratch)) {
+        return false;
+    }
+    if (rewind.get_frame_count() != 0 || !pushed.empty()) {
+        Common::err(rewind.get_frame_count(), " frames left after popping everything");
+        return false;
+    }
+    // the ring has to have been small enough to run full
+    return evictions > 0;
+}
+
+/**
+ * Keyframes only, with sizes picked so that the ring wraps while the
+ * oldest record still sits behind the write position and doesn't overlap
+ * the start of the ring.
+ */
+static bool run_wrap_behind_head()
+{
+    RewindBuffer rewind(10000, 1);
+    std::vector<std::unique_ptr<MachineState>> pushed;
+    unsigned int frame = 0;
+    for (unsigned int literals : { 3900, 2900, 2400, 2900, 1400, 5900 }) {
+        auto state = std::make_unique<MachineState>();
+        state->cpu.cycle_count = ++frame;
+        memset(state->memory, 0xFF, literals);
+        rewind.push(*state);
+        pushed.push_back(std::move(state));
+    }
+    // only the last one fits next to what had to go
+    if (rewind.get_frame_count() != 1) {
+        Common::err(rewind.get_frame_count(), " frames kept after wrapping behind the head");
+        return false;
+    }
+    pushed.erase(pushed.begin(), pushed.end() - 1);
+    auto scratch = std::make_unique<MachineState>();
+    return check_pops(rewind, pushed, pushed.size(), *scratch);
+}
+
+int main()
+{
+    if (!run_wrap_behind_head()) {
+        return Common::EXIT_FAIL;
+    }
+
+    for (Common::u64 seed = 1; seed <= 3; seed++) {
+        for (Common::u64 capacity : { 40u << 10u, 64u << 10u, 256u << 10u }) {
+            for (unsigned int interval : { 1u, 8u, 60u }) {
+                if (!run(capacity, interval, seed)) {
+                    Common::err("failed with capacity ", capacity, ", keyframe interval ", interval, ", seed ", seed);
+                    return Common::EXIT_FAIL;
+                }
+            }
+        }
+    }
+
+    // a state that doesn't fit at all must not leave older history behind
+    RewindBuffer tiny(4096);
+    auto state = std::make_unique<MachineState>();
+    tiny.push(*state);
+    if (tiny.get_frame_count() != 1) {
+        Common::err("a zero state didn't fit into ", 4096, " bytes");
+        return Common::EXIT_FAIL;
+    }
+    memset(state->memory, 0x5A, sizeof(state->memory));
+    tiny.push(*state);
+    if (tiny.get_frame_count() != 0) {
+        Common::err("an oversized state left ", tiny.get_frame_count(), " frames behind");
+        return Common::EXIT_FAIL;
+    }
+    Common::msg("rewind: ok");
+    return Common::EXIT_SUCC;
+}
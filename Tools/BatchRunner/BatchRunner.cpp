@@ -0,0 +1,126 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "BatchRunner.h"
+#include <Machine.h>
+#include <ThreadPool.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+Chip8::BatchRunner::BatchRunner(BatchOptions options)
+    : m_options(options)
+{
+}
+
+void Chip8::BatchRunner::add_rom(const std::string& path)
+{
+    m_roms.emplace_back(path);
+}
+
+void Chip8::BatchRunner::add_directory(const std::string& path)
+{
+    std::vector<std::string> roms;
+    for (const auto& entry : std::filesystem::directory_iterator(path)) {
+        auto extension = entry.path().extension();
+        if (entry.is_regular_file() && (extension == ".ch8" || extension == ".c8" || extension == ".sc8" || extension == ".xo8")) {
+            roms.emplace_back(entry.path().string());
+        }
+    }
+    std::sort(roms.begin(), roms.end());
+    m_roms.insert(m_roms.end(), roms.begin(), roms.end());
+}
+
+std::vector<Chip8::BatchResult> Chip8::BatchRunner::run()
+{
+    std::vector<BatchResult> results(m_roms.size() * m_options.instances_per_rom);
+    for (size_t i = 0; i < results.size(); i++) {
+        results[i].rom = m_roms[i / m_options.instances_per_rom];
+        results[i].instance = i % m_options.instances_per_rom;
+        results[i].seed = m_options.seed + results[i].instance;
+    }
+
+    Common::ThreadPool pool(m_options.threads > 0 ? m_options.threads : std::thread::hardware_concurrency());
+    for (BatchResult& result : results) {
+        pool.submit([&result, this] { run_one(result, m_options); });
+    }
+    pool.wait();
+    return results;
+}
+
+void Chip8::BatchRunner::run_one(BatchResult& result, const BatchOptions& options)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto machine = std::make_unique<Machine>();
+    result.loaded = machine->load_program(result.rom);
+    if (result.loaded) {
+        Cpu& cpu = machine->get_cpu();
+        cpu.set_core(options.core);
+        cpu.set_cycles_per_frame(options.cycles_per_frame);
+        cpu.set_seed(result.seed);
+        cpu.set_quirks(quirks_for_file(result.rom));
+        RunResult run = cpu.run_cycles(options.cycles);
+        result.cycles = run.cycles;
+        result.reason = run.reason;
+        result.framebuffer_hash = machine->get_display().hash();
+    }
+    auto end = std::chrono::steady_clock::now();
+    result.wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static std::string escape_json(const std::string& value)
+{
+    static const char* const HEX_DIGITS = "0123456789abcdef";
+    std::string escaped;
+    for (char c : value) {
+        auto byte = static_cast<unsigned char>(c);
+        if (byte < 0x20) {
+            // control characters aren't allowed in JSON strings
+            escaped += "\\u00";
+            escaped += HEX_DIGITS[byte >> 4u];
+            escaped += HEX_DIGITS[byte & 0xFu];
+            continue;
+        }
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+void Chip8::BatchRunner::write_json_lines(std::ostream& out, const std::vector<BatchResult>& results)
+{
+    for (const BatchResult& result : results) {
+        out << "{\"rom\":\"" << escape_json(result.rom) << "\""
+            << ",\"instance\":" << result.instance
+            << ",\"seed\":" << result.seed
+            << ",\"loaded\":" << (result.loaded ? "true" : "false")
+            << ",\"cycles\":" << result.cycles
+            << ",\"framebuffer_hash\":\"" << Common::int_to_hex(result.framebuffer_hash) << "\""
+            << ",\"stop_reason\":\"" << to_string(result.reason) << "\""
+            << ",\"wall_ms\":" << result.wall_ms
+            << "}\n";
+    }
+    out << std::flush;
+}
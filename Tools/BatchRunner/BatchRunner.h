@@ -0,0 +1,71 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include <Cpu.h>
+#include <Types.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Chip8 {
+    struct BatchOptions {
+        Common::u64 cycles = 10000000;
+        unsigned int threads = 0;
+        // every ROM runs this many times, each instance with its own seed
+        unsigned int instances_per_rom = 1;
+        unsigned int cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+        CpuCore core = Cpu::default_core();
+        // instance i is seeded with seed + i, results don't depend on the
+        // number of threads
+        Common::u64 seed = DEFAULT_SEED;
+    };
+
+    // one slot per run, each written by a single worker only
+    struct alignas(Common::CACHE_LINE_SIZE) BatchResult {
+        std::string rom;
+        unsigned int instance = 0;
+        Common::u64 seed = 0;
+        bool loaded = false;
+        Common::u64 cycles = 0;
+        Common::u64 framebuffer_hash = 0;
+        StopReason reason = StopReason::BudgetExhausted;
+        double wall_ms = 0;
+    };
+
+    class BatchRunner final {
+    public:
+        explicit BatchRunner(BatchOptions options);
+        void add_rom(const std::string& path);
+        void add_directory(const std::string& path);
+        std::vector<BatchResult> run();
+        static void write_json_lines(std::ostream& out, const std::vector<BatchResult>& results);
+
+    private:
+        static void run_one(BatchResult& result, const BatchOptions& options);
+
+    private:
+        BatchOptions m_options;
+        std::vector<std::string> m_roms;
+    };
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include "BatchRunner.h"
+#include <Print.h>
+#include <Types.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    Chip8::BatchOptions options;
+    std::string output;
+    std::vector<std::string> inputs;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--cycles" && has_value) {
+                options.cycles = Common::parse_unsigned(argv[++i]);
+            } else if (arg == "--ipf" && has_value) {
+                options.cycles_per_frame = Common::parse_unsigned(argv[++i]);
+            } else if (arg == "--threads" && has_value) {
+                options.threads = Common::parse_unsigned(argv[++i]);
+            } else if (arg == "--instances-per-rom" && has_value) {
+                options.instances_per_rom = std::max<Common::u64>(1, Common::parse_unsigned(argv[++i]));
+            } else if (arg == "--core" && has_value && Chip8::parse_core(argv[i + 1], options.core)) {
+                ++i;
+            } else if (arg == "--seed" && has_value) {
+                options.seed = Common::parse_unsigned(argv[++i], 0);
+            } else if (arg == "--output" && has_value) {
+                output = argv[++i];
+            } else if (arg.rfind("--", 0) != 0) {
+                inputs.emplace_back(arg);
+            } else {
+                inputs.clear();
+                break;
+            }
+        }
+    } catch (const std::logic_error&) {
+        // not a number, or a negative one
+        inputs.clear();
+    }
+    if (inputs.empty()) {
+        Common::err("Usage: ./Chip8Batch [--cycles N] [--ipf N] [--threads N] [--instances-per-rom N] [--core table|switch|threaded|jit] [--seed N] [--output FILE] <ROM|DIRECTORY>...\n");
+        return Common::EXIT_FAIL;
+    }
+
+    Chip8::BatchRunner runner(options);
+    for (const std::string& input : inputs) {
+        if (std::filesystem::is_directory(input)) {
+            runner.add_directory(input);
+        } else {
+            runner.add_rom(input);
+        }
+    }
+    auto results = runner.run();
+
+    if (output.empty()) {
+        Chip8::BatchRunner::write_json_lines(std::cout, results);
+    } else {
+        std::ofstream out(output);
+        Chip8::BatchRunner::write_json_lines(out, results);
+    }
+    return Common::EXIT_SUCC;
+}
@@ -0,0 +1,197 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Benchmark.h"
+#include <Machine.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+double Chip8::BenchResult::median_seconds() const
+{
+    if (seconds.empty()) {
+        return 0;
+    }
+    std::vector<double> sorted = seconds;
+    std::sort(sorted.begin(), sorted.end());
+    size_t middle = sorted.size() / 2;
+    return sorted.size() % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+}
+
+double Chip8::BenchResult::median_mips() const
+{
+    double median = median_seconds();
+    return median > 0 ? static_cast<double>(cycles) / median / 1e6 : 0;
+}
+
+double Chip8::BenchResult::mips_stddev() const
+{
+    if (seconds.size() < 2) {
+        return 0;
+    }
+    std::vector<double> mips;
+    for (double run : seconds) {
+        mips.push_back(static_cast<double>(cycles) / run / 1e6);
+    }
+    double mean = 0;
+    for (double value : mips) {
+        mean += value;
+    }
+    mean /= static_cast<double>(mips.size());
+    double variance = 0;
+    for (double value : mips) {
+        variance += (value - mean) * (value - mean);
+    }
+    return std::sqrt(variance / static_cast<double>(mips.size() - 1));
+}
+
+double Chip8::BenchResult::ns_per_instruction() const
+{
+    return cycles > 0 ? median_seconds() * 1e9 / static_cast<double>(cycles) : 0;
+}
+
+double Chip8::BenchResult::frames_per_second() const
+{
+    double median = median_seconds();
+    return median > 0 ? static_cast<double>(frames) / median : 0;
+}
+
+Chip8::Benchmark::Benchmark(BenchOptions options)
+    : m_options(options)
+    , m_input(scripted_input(options.cycles, options.cycles_per_frame))
+{
+}
+
+/**
+ * Walks through all sixteen keys, holding each for ten frames and then
+ * leaving the keypad alone for twenty, so ROMs waiting on keys get going
+ * and games actually move.
+ */
+Chip8::InputLog Chip8::Benchmark::scripted_input(Common::u64 cycles, unsigned int cycles_per_frame)
+{
+    InputLog log;
+    log.set_cycles_per_frame(cycles_per_frame);
+    Common::u64 period = 30ull * cycles_per_frame;
+    for (Common::u64 start = period, key = 0; start < cycles; start += period, key = (key + 1) % KEY_COUNT) {
+        log.record(start, static_cast<uint16_t>(1u << key));
+        log.record(start + 10ull * cycles_per_frame, 0);
+    }
+    return log;
+}
+
+Chip8::BenchResult Chip8::Benchmark::run(const std::string& rom)
+{
+    BenchResult result;
+    result.rom = rom;
+    for (unsigned int repetition = 0; repetition <= m_options.repetitions; repetition++) {
+        auto machine = std::make_unique<Machine>();
+        if (!machine->load_program(rom)) {
+            return result;
+        }
+        Cpu& cpu = machine->get_cpu();
+        cpu.set_core(m_options.core);
+        cpu.set_cycles_per_frame(m_options.cycles_per_frame);
+        cpu.set_seed(m_input.get_seed());
+        cpu.set_idle_skipping(m_options.idle_skipping);
+        cpu.set_fusion(m_options.fusion);
+        cpu.set_quirks(quirks_for_file(rom));
+        InputReplay replay(m_input);
+
+        auto start = std::chrono::steady_clock::now();
+        RunResult run = replay.run_until(cpu, 0, m_options.cycles);
+        auto end = std::chrono::steady_clock::now();
+
+        Common::u64 hash = machine->get_display().hash();
+        if (repetition == 0) {
+            result.loaded = true;
+            result.cycles = run.cycles;
+            result.frames = cpu.get_frame_count();
+            result.framebuffer_hash = hash;
+#ifdef CHIP8_PROFILER
+            m_sequences->add_sequences(cpu.get_profiler());
+#endif
+            continue;
+        }
+        result.deterministic &= run.cycles == result.cycles && hash == result.framebuffer_hash;
+        result.seconds.push_back(std::chrono::duration<double>(end - start).count());
+    }
+    return result;
+}
+
+#ifdef CHIP8_PROFILER
+const Chip8::Profiler& Chip8::Benchmark::get_sequences() const
+{
+    return *m_sequences;
+}
+#endif
+
+static const std::string OPTIONS_PREFIX = "# options: ";
+
+std::string Chip8::describe_options(const BenchOptions& options)
+{
+    std::ostringstream out;
+    out << "core " << to_string(options.core) << ", " << options.cycles << " cycles, "
+        << options.cycles_per_frame << " instructions per frame, idle skipping "
+        << (options.idle_skipping ? "on" : "off") << ", fusion " << (options.fusion ? "on" : "off");
+    return out.str();
+}
+
+Chip8::Baseline Chip8::load_baseline(const std::string& file)
+{
+    Baseline baseline;
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.rfind(OPTIONS_PREFIX, 0) == 0) {
+            baseline.options = line.substr(OPTIONS_PREFIX.size());
+            continue;
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string rom;
+        BaselineEntry entry {};
+        if (fields >> rom >> entry.mips >> std::hex >> entry.framebuffer_hash) {
+            baseline.entries[rom] = entry;
+        }
+    }
+    return baseline;
+}
+
+bool Chip8::save_baseline(const std::string& file, const std::vector<BenchResult>& results, const BenchOptions& options)
+{
+    std::ofstream out(file);
+    out << OPTIONS_PREFIX << describe_options(options) << '\n';
+    for (const BenchResult& result : results) {
+        if (result.loaded) {
+            out << std::filesystem::path(result.rom).filename().string() << ' ' << result.median_mips() << ' '
+                << Common::int_to_hex(result.framebuffer_hash) << '\n';
+        }
+    }
+    return out.good();
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include <Cpu.h>
+#include <InputLog.h>
+#include <Types.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Chip8 {
+    struct BenchOptions {
+        Common::u64 cycles = 20000000;
+        unsigned int repetitions = 5;
+        unsigned int cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+        CpuCore core = Cpu::default_core();
+        // off by default, skipped instructions would inflate the numbers
+        bool idle_skipping = false;
+        bool fusion = true;
+    };
+
+    struct BenchResult {
+        std::string rom;
+        bool loaded = false;
+        // true when every repetition ended with the same framebuffer
+        bool deterministic = true;
+        Common::u64 cycles = 0;
+        Common::u64 frames = 0;
+        Common::u64 framebuffer_hash = 0;
+        std::vector<double> seconds;
+
+        double median_seconds() const;
+        double median_mips() const;
+        double mips_stddev() const;
+        double ns_per_instruction() const;
+        double frames_per_second() const;
+    };
+
+    struct BaselineEntry {
+        double mips;
+        Common::u64 framebuffer_hash;
+    };
+
+    struct Baseline {
+        // describe_options of the run that saved it, empty for baselines
+        // saved before it was recorded
+        std::string options;
+        std::map<std::string, BaselineEntry> entries;
+    };
+
+    /**
+     * Runs ROMs headless with the same scripted input and seed every time
+     * and measures the wall time of each repetition. One untimed warm up
+     * run precedes the repetitions.
+     */
+    class Benchmark final {
+    public:
+        explicit Benchmark(BenchOptions options);
+        BenchResult run(const std::string& rom);
+#ifdef CHIP8_PROFILER
+        const Profiler& get_sequences() const;
+#endif
+
+        static InputLog scripted_input(Common::u64 cycles, unsigned int cycles_per_frame);
+
+    private:
+        BenchOptions m_options;
+        InputLog m_input;
+#ifdef CHIP8_PROFILER
+        // instruction sequences of the warm up runs of every ROM so far
+        std::unique_ptr<Profiler> m_sequences = std::make_unique<Profiler>();
+#endif
+    };
+
+    // the options that change the numbers, baselines only compare if they match
+    std::string describe_options(const BenchOptions& options);
+
+    /**
+     * Baseline files start with a "# options: " line and hold one
+     * "<rom file name> <mips> <framebuffer hash>" line per ROM, other
+     * lines starting with # are comments.
+     */
+    Baseline load_baseline(const std::string& file);
+    bool save_baseline(const std::string& file, const std::vector<BenchResult>& results, const BenchOptions& options);
+}
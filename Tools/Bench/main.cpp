@@ -0,0 +1,153 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+#include "Benchmark.h"
+#include <Print.h>
+#include <Types.h>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static const char* const BUNDLED_ROMS[] = { "pong.ch8", "test_opcode.ch8", "chip8-test-rom.ch8", "c8_test.c8" };
+
+static int usage()
+{
+    Common::err("Usage: ./chip8_bench [--cycles N] [--repetitions N] [--ipf N] [--core table|switch|threaded|jit] [--idle-skipping] [--no-fusion] [--baseline FILE] [--save-baseline FILE] [--threshold PERCENT] [ROM]...\n");
+    return Common::EXIT_FAIL;
+}
+
+int main(int argc, char** argv)
+{
+    Chip8::BenchOptions options;
+    std::string baseline_file;
+    std::string save_baseline_file;
+    double threshold = 5.0;
+    std::vector<std::string> roms;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--cycles" && has_value) {
+                options.cycles = Common::parse_unsigned(argv[++i]);
+            } else if (arg == "--repetitions" && has_value) {
+                options.repetitions = std::max<Common::u64>(1, Common::parse_unsigned(argv[++i]));
+            } else if (arg == "--ipf" && has_value) {
+                options.cycles_per_frame = Common::parse_unsigned(argv[++i]);
+                if (options.cycles_per_frame == 0) {
+                    // the scripted input is laid out in frames
+                    return usage();
+                }
+            } else if (arg == "--core" && has_value && Chip8::parse_core(argv[i + 1], options.core)) {
+                ++i;
+            } else if (arg == "--idle-skipping") {
+                options.idle_skipping = true;
+            } else if (arg == "--no-fusion") {
+                options.fusion = false;
+            } else if (arg == "--baseline" && has_value) {
+                baseline_file = argv[++i];
+            } else if (arg == "--save-baseline" && has_value) {
+                save_baseline_file = argv[++i];
+            } else if (arg == "--threshold" && has_value) {
+                threshold = std::stod(argv[++i]);
+            } else if (arg.rfind("--", 0) != 0) {
+                roms.emplace_back(arg);
+            } else {
+                return usage();
+            }
+        }
+    } catch (const std::logic_error&) {
+        // not a number, or a negative one
+        return usage();
+    }
+    if (roms.empty()) {
+        for (const char* rom : BUNDLED_ROMS) {
+            roms.emplace_back((std::filesystem::path(CHIP8_ROM_DIR) / rom).string());
+        }
+    }
+
+    Common::msg("core ", Chip8::to_string(options.core), ", ", options.cycles, " cycles, ", options.repetitions, " repetitions");
+    Chip8::Benchmark benchmark(options);
+    std::vector<Chip8::BenchResult> results;
+    std::cout << std::left << std::setw(22) << "rom" << std::right << std::setw(10) << "MIPS" << std::setw(9) << "+-"
+              << std::setw(10) << "ns/instr" << std::setw(12) << "frames/s" << "  framebuffer\n";
+    for (const std::string& rom : roms) {
+        Chip8::BenchResult result = benchmark.run(rom);
+        std::string name = std::filesystem::path(rom).filename().string();
+        if (!result.loaded) {
+            Common::err("Failed to open ", rom);
+            return Common::EXIT_FAIL;
+        }
+        std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << result.median_mips() << std::setw(9) << result.mips_stddev()
+                  << std::setw(10) << result.ns_per_instruction() << std::setw(12) << std::setprecision(0) << result.frames_per_second()
+                  << "  " << Common::int_to_hex(result.framebuffer_hash) << (result.deterministic ? "" : " (differs between runs)") << '\n';
+        results.push_back(result);
+    }
+    std::cout << std::defaultfloat << std::setprecision(3);
+#ifdef CHIP8_PROFILER
+    Common::msg("instruction sequences across ", results.size(), " ROMs:");
+    benchmark.get_sequences().write_sequences(std::cout);
+    std::cout << std::setprecision(3);
+#endif
+
+    int status = Common::EXIT_SUCC;
+    Chip8::Baseline baseline;
+    if (!baseline_file.empty()) {
+        baseline = Chip8::load_baseline(baseline_file);
+        std::string current = Chip8::describe_options(options);
+        if (baseline.options.empty()) {
+            Common::err(baseline_file, " doesn't say which options it was measured with, comparing anyway");
+        } else if (baseline.options != current) {
+            // numbers measured with other options say nothing about this build
+            Common::err(baseline_file, " was measured with ", baseline.options, ", not with ", current, ", not comparing");
+            baseline.entries.clear();
+            status = Common::EXIT_FAIL;
+        }
+    }
+    if (!baseline.entries.empty()) {
+        for (const Chip8::BenchResult& result : results) {
+            std::string name = std::filesystem::path(result.rom).filename().string();
+            auto entry = baseline.entries.find(name);
+            if (entry == baseline.entries.end()) {
+                Common::msg(name, ": not in baseline");
+                continue;
+            }
+            double change = (result.median_mips() / entry->second.mips - 1.0) * 100.0;
+            bool regressed = change < -threshold;
+            Common::msg(name, ": ", change, "% against baseline", regressed ? " REGRESSION" : "");
+            if (entry->second.framebuffer_hash != result.framebuffer_hash) {
+                Common::msg(name, ": framebuffer differs from baseline, emulation changed");
+            }
+            if (regressed) {
+                status = Common::EXIT_FAIL;
+            }
+        }
+    }
+    if (!save_baseline_file.empty() && !Chip8::save_baseline(save_baseline_file, results, options)) {
+        Common::err("Failed to write baseline ", save_baseline_file);
+        return Common::EXIT_FAIL;
+    }
+    return status;
+}
@@ -0,0 +1,460 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Recompiler.h"
+#include <RecompiledAbi.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+// the last label is followed by nothing, so nothing can fall through into it
+static constexpr uint32_t NO_LABEL = 0x10000;
+
+static std::string hex(uint32_t value, int digits)
+{
+    std::ostringstream out;
+    out << "0x" << std::uppercase << std::hex << std::setw(digits) << std::setfill('0') << value;
+    return out.str();
+}
+
+static std::string label(uint32_t address)
+{
+    std::ostringstream out;
+    out << "L_" << std::uppercase << std::hex << std::setw(3) << std::setfill('0') << address;
+    return out.str();
+}
+
+static std::string reg(uint8_t index)
+{
+    return "V[" + hex(index, 1) + "]";
+}
+
+Chip8::Recompiler::Recompiler(std::vector<uint8_t> program, QuirkProfile quirks)
+    : m_program(std::move(program))
+    , m_quirks(quirks)
+    , m_quirk_flags(get_quirk_flags(quirks))
+    , m_reachable(PROGRAM_START + m_program.size(), false)
+{
+}
+
+bool Chip8::Recompiler::is_instruction(uint32_t address) const
+{
+    return address >= PROGRAM_START && address + 1 < PROGRAM_START + m_program.size() && address + 1 < CODE_END;
+}
+
+uint16_t Chip8::Recompiler::opcode_at(uint32_t address) const
+{
+    size_t offset = address - PROGRAM_START;
+    return static_cast<uint16_t>(m_program[offset] << 8u | m_program[offset + 1]);
+}
+
+/**
+ * Decodes to the operation the profile runs, instructions it doesn't
+ * have fall back like they do in the interpreter.
+ */
+Chip8::Instruction Chip8::Recompiler::decode_at(uint32_t address) const
+{
+    Instruction instruction = decode(opcode_at(address));
+    instruction.operation = resolve_operation(instruction, m_quirk_flags);
+    return instruction;
+}
+
+void Chip8::Recompiler::reach(uint32_t address)
+{
+    if (!is_instruction(address)) {
+        ++m_stats.external_targets;
+        return;
+    }
+    if (!m_reachable[address]) {
+        m_reachable[address] = true;
+        m_pending.push_back(static_cast<uint16_t>(address));
+    }
+}
+
+/**
+ * Where a taken skip at address goes on, over both words of a long load
+ * with the XO-CHIP quirks.
+ */
+uint32_t Chip8::Recompiler::skip_target(uint32_t address) const
+{
+    if (m_quirk_flags.skips_long_loads && is_instruction(address + 2) && opcode_at(address + 2) == 0xF000) {
+        return address + 6;
+    }
+    return address + 4;
+}
+
+/**
+ * Jump tables for Bnnn are usually a run of 1nnn (or 2nnn) instructions,
+ * V0 (or Vx for Bxnn) picking one of them. The first entry is always taken since V0 may
+ * just as well be 0.
+ */
+void Chip8::Recompiler::follow_jump_table(uint16_t base)
+{
+    reach(base);
+    ++m_stats.jump_table_entries;
+    for (unsigned int entry = 1; entry < MAX_JUMP_TABLE_ENTRIES; entry++) {
+        uint32_t address = base + 2 * entry;
+        if (!is_instruction(address)) {
+            break;
+        }
+        Operation operation = decode_at(address).operation;
+        if (operation != Operation::Op1nnn && operation != Operation::Op2nnn) {
+            break;
+        }
+        reach(address);
+        ++m_stats.jump_table_entries;
+    }
+}
+
+void Chip8::Recompiler::analyse()
+{
+    std::fill(m_reachable.begin(), m_reachable.end(), false);
+    m_stats = {};
+    reach(PROGRAM_START);
+    while (!m_pending.empty()) {
+        uint16_t address = m_pending.back();
+        m_pending.pop_back();
+        ++m_stats.instructions;
+        Instruction instruction = decode_at(address);
+        switch (instruction.operation) {
+        case Operation::None:
+        case Operation::Op00EE:
+            break;
+        case Operation::Op1nnn:
+            reach(instruction.nnn);
+            break;
+        case Operation::Op2nnn:
+            reach(instruction.nnn);
+            reach(address + 2);
+            break;
+        case Operation::OpBnnn:
+            ++m_stats.indirect_jumps;
+            follow_jump_table(instruction.nnn);
+            break;
+        case Operation::Op3xkk:
+        case Operation::Op4xkk:
+        case Operation::Op5xy0:
+        case Operation::Op9xy0:
+        case Operation::OpEx9E:
+        case Operation::OpExA1:
+            reach(address + 2);
+            reach(skip_target(address));
+            break;
+        case Operation::OpF000:
+            reach(address + 4);
+            break;
+        default:
+            reach(address + 2);
+            break;
+        }
+    }
+}
+
+Chip8::RecompilerStats Chip8::Recompiler::get_stats() const
+{
+    return m_stats;
+}
+
+void Chip8::Recompiler::write(std::ostream& out, const std::string& source_name) const
+{
+    std::vector<uint16_t> addresses;
+    for (uint32_t address = PROGRAM_START; address < m_reachable.size(); address++) {
+        if (m_reachable[address]) {
+            addresses.push_back(static_cast<uint16_t>(address));
+        }
+    }
+
+    out << "// Generated by chip8_recompile from " << source_name << ", do not edit.\n"
+        << "#include \"RecompiledAbi.h\"\n"
+        << "\n"
+        << "#define STEP(address) \\\n"
+        << "    if (cycles == 0) {  \\\n"
+        << "        pc = address;   \\\n"
+        << "        return 0;       \\\n"
+        << "    }                   \\\n"
+        << "    --cycles\n"
+        << "\n"
+        << "// hands the instruction to the interpreter, pc already points behind it\n"
+        << "#define CALL(next, opcode)                   \\\n"
+        << "    pc = next;                               \\\n"
+        << "    if (context->execute(cpu, opcode)) {     \\\n"
+        << "        return cycles;                       \\\n"
+        << "    }\n"
+        << "\n"
+        << "// same for instructions writing memory, which may hit recompiled code\n"
+        << "#define WRITE(next, opcode)                                          \\\n"
+        << "    pc = next;                                                       \\\n"
+        << "    if (context->execute(cpu, opcode) || *context->code_written) {   \\\n"
+        << "        return cycles;                                               \\\n"
+        << "    }\n"
+        << "\n"
+        << "namespace {\n"
+        << "    const uint8_t image[] = {";
+    for (size_t i = 0; i < m_program.size(); i++) {
+        out << (i % 16 == 0 ? "\n        " : " ") << hex(m_program[i], 2) << ",";
+    }
+    out << "\n    };\n"
+        << "\n"
+        << "    const uint16_t addresses[] = {";
+    for (size_t i = 0; i < addresses.size(); i++) {
+        out << (i % 12 == 0 ? "\n        " : " ") << hex(addresses[i], 3) << ",";
+    }
+    out << "\n    };\n"
+        << "\n"
+        << "    uint64_t run(Chip8RecompiledContext* context, uint64_t cycles)\n"
+        << "    {\n"
+        << "        uint8_t* const V = context->registers;\n"
+        << "        [[maybe_unused]] uint16_t& I = *context->address_register;\n"
+        << "        uint16_t& pc = *context->program_counter;\n"
+        << "        [[maybe_unused]] uint16_t* const stack = context->stack;\n"
+        << "        [[maybe_unused]] uint8_t& sp = *context->sp;\n"
+        << "        [[maybe_unused]] const uint8_t* const memory = context->memory;\n"
+        << "        void* const cpu = context->cpu;\n"
+        << "\n"
+        << "        // every pass through the loop dispatches on pc, continue jumps to a dynamic target\n"
+        << "        for (;;) {\n"
+        << "        switch (pc) {\n";
+    for (uint16_t address : addresses) {
+        out << "        case " << hex(address, 3) << ": goto " << label(address) << ";\n";
+    }
+    out << "        default:\n"
+        << "            return cycles;\n"
+        << "        }\n";
+    for (size_t i = 0; i < addresses.size(); i++) {
+        write_instruction(out, addresses[i], i + 1 < addresses.size() ? addresses[i + 1] : NO_LABEL);
+    }
+    out << "        }\n"
+        << "    }\n"
+        << "}\n"
+        << "\n"
+        << "extern \"C\" const Chip8RecompiledRom* " << CHIP8_RECOMPILED_SYMBOL << "()\n"
+        << "{\n"
+        << "    static const Chip8RecompiledRom rom = {\n"
+        << "        CHIP8_RECOMPILED_ABI_VERSION,\n"
+        << "        " << static_cast<uint32_t>(m_quirks) << ", // " << to_string(m_quirks) << " quirks\n"
+        << "        image,\n"
+        << "        sizeof(image),\n"
+        << "        addresses,\n"
+        << "        sizeof(addresses) / sizeof(addresses[0]),\n"
+        << "        run\n"
+        << "    };\n"
+        << "    return &rom;\n"
+        << "}\n";
+}
+
+/**
+ * Continues at target, falling through when it is the next label and
+ * returning to the interpreter when it wasn't recompiled.
+ */
+void Chip8::Recompiler::write_jump(std::ostream& out, uint32_t next_label, uint32_t target) const
+{
+    if (target == next_label) {
+        return;
+    }
+    if (target < m_reachable.size() && m_reachable[target]) {
+        out << "        goto " << label(target) << ";\n";
+        return;
+    }
+    out << "        pc = " << hex(target, 3) << ";\n"
+        << "        return cycles;\n";
+}
+
+void Chip8::Recompiler::write_instruction(std::ostream& out, uint16_t address, uint32_t next_label) const
+{
+    uint16_t opcode = opcode_at(address);
+    Instruction instruction = decode_at(address);
+    std::string vx = reg(instruction.x);
+    std::string vy = reg(instruction.y);
+    // 8xy6 and 8xyE read the register again after writing VF, like the handlers
+    std::string shifted = m_quirk_flags.shift_uses_vy ? vy : vx;
+    std::string kk = hex(instruction.kk, 2);
+    std::string nnn = hex(instruction.nnn, 3);
+    std::string next = hex(address + 2, 3);
+    std::string code = hex(opcode, 4);
+
+    out << "    " << label(address) << ": // " << code << " " << to_string(instruction.operation) << "\n"
+        << "        STEP(" << hex(address, 3) << ");\n";
+    switch (instruction.operation) {
+    case Operation::None:
+        out << "        CALL(" << next << ", " << code << ");\n"
+            << "        return cycles;\n";
+        return;
+    case Operation::Op00E0:
+    case Operation::Op00Cn:
+    case Operation::Op00Dn:
+    case Operation::Op00FB:
+    case Operation::Op00FC:
+    case Operation::Op00FE:
+    case Operation::Op00FF:
+    case Operation::OpCxkk:
+    case Operation::OpDxyn:
+    case Operation::Op5xy3:
+    case Operation::OpFn01:
+    case Operation::OpF002:
+    case Operation::OpFx15:
+    case Operation::OpFx18:
+    case Operation::OpFx3A:
+        out << "        CALL(" << next << ", " << code << ");\n";
+        break;
+    case Operation::Op5xy2:
+    case Operation::OpFx33:
+    case Operation::OpFx55:
+        out << "        WRITE(" << next << ", " << code << ");\n";
+        break;
+    case Operation::OpEx9E:
+    case Operation::OpExA1:
+    case Operation::OpFx0A:
+    case Operation::OpF000:
+        // the interpreter decides where to go on
+        out << "        CALL(" << next << ", " << code << ");\n"
+            << "        continue;\n";
+        return;
+    case Operation::Op00EE:
+        out << "        if (sp == 0) {\n"
+            << "            CALL(" << next << ", " << code << ");\n"
+            << "            return cycles;\n"
+            << "        }\n"
+            << "        pc = stack[--sp];\n"
+            << "        *context->idle_pure = false;\n"
+            << "        continue;\n";
+        return;
+    case Operation::Op1nnn:
+        if (instruction.nnn <= address) {
+            out << "        pc = " << nnn << ";\n"
+                << "        if (context->idle_check(cpu, " << hex(address, 3) << ")) {\n"
+                << "            return cycles;\n"
+                << "        }\n";
+        }
+        write_jump(out, next_label, instruction.nnn);
+        return;
+    case Operation::Op2nnn:
+        out << "        if (sp == 16) {\n"
+            << "            CALL(" << next << ", " << code << ");\n"
+            << "            return cycles;\n"
+            << "        }\n"
+            << "        stack[sp++] = " << next << ";\n"
+            << "        *context->idle_pure = false;\n";
+        write_jump(out, next_label, instruction.nnn);
+        return;
+    case Operation::Op3xkk:
+        out << "        if (" << vx << " == " << kk << ") {\n";
+        write_jump(out, NO_LABEL, skip_target(address));
+        out << "        }\n";
+        break;
+    case Operation::Op4xkk:
+        out << "        if (" << vx << " != " << kk << ") {\n";
+        write_jump(out, NO_LABEL, skip_target(address));
+        out << "        }\n";
+        break;
+    case Operation::Op5xy0:
+        out << "        if (" << vx << " == " << vy << ") {\n";
+        write_jump(out, NO_LABEL, skip_target(address));
+        out << "        }\n";
+        break;
+    case Operation::Op9xy0:
+        out << "        if (" << vx << " != " << vy << ") {\n";
+        write_jump(out, NO_LABEL, skip_target(address));
+        out << "        }\n";
+        break;
+    case Operation::Op6xkk:
+        out << "        " << vx << " = " << kk << ";\n";
+        break;
+    case Operation::Op7xkk:
+        out << "        " << vx << " += " << kk << ";\n";
+        break;
+    case Operation::Op8xy0:
+        out << "        " << vx << " = " << vy << ";\n";
+        break;
+    case Operation::Op8xy1:
+    case Operation::Op8xy2:
+    case Operation::Op8xy3: {
+        static const char* const operators[] = { " |= ", " &= ", " ^= " };
+        int index = static_cast<int>(instruction.operation) - static_cast<int>(Operation::Op8xy1);
+        out << "        " << vx << operators[index] << vy << ";\n";
+        if (m_quirk_flags.logic_resets_vf) {
+            out << "        V[0xF] = 0;\n";
+        }
+        break;
+    }
+    case Operation::Op8xy4:
+        out << "        {\n"
+            << "            unsigned int sum = " << vx << " + " << vy << ";\n"
+            << "            V[0xF] = sum > 0xFF ? 1 : 0;\n"
+            << "            " << vx << " = static_cast<uint8_t>(sum);\n"
+            << "        }\n";
+        break;
+    case Operation::Op8xy5:
+        // VF is written first, the subtraction sees it when x or y is F
+        out << "        V[0xF] = " << vx << " > " << vy << " ? 1 : 0;\n"
+            << "        " << vx << " -= " << vy << ";\n";
+        break;
+    case Operation::Op8xy6:
+        out << "        V[0xF] = " << shifted << " & 0x1;\n"
+            << "        " << vx << " = " << shifted << " >> 1;\n";
+        break;
+    case Operation::Op8xy7:
+        out << "        V[0xF] = " << vy << " > " << vx << " ? 1 : 0;\n"
+            << "        " << vx << " = static_cast<uint8_t>(" << vy << " - " << vx << ");\n";
+        break;
+    case Operation::Op8xyE:
+        out << "        V[0xF] = " << shifted << " >> 7;\n"
+            << "        " << vx << " = static_cast<uint8_t>(" << shifted << " << 1);\n";
+        break;
+    case Operation::OpAnnn:
+        out << "        I = " << nnn << ";\n";
+        break;
+    case Operation::OpBnnn:
+        out << "        pc = " << (m_quirk_flags.jump_uses_vx ? vx : reg(0)) << " + " << nnn << ";\n"
+            << "        continue;\n";
+        return;
+    case Operation::OpFx07:
+        out << "        " << vx << " = *context->delay_timer;\n";
+        break;
+    case Operation::OpFx1E:
+        out << "        I += " << vx << ";\n";
+        break;
+    case Operation::OpFx29:
+        out << "        I = 0x50 + 5 * " << vx << ";\n";
+        break;
+    case Operation::OpFx30:
+        out << "        I = 0xA0 + 10 * (" << vx << " & 0xF);\n";
+        break;
+    case Operation::OpFx65:
+        // reads running past the end of memory are left to the interpreter,
+        // only XO-CHIP programs are sure to have more than 4 KB
+        out << "        if (I + " << hex(instruction.x, 1) << " < " << hex(m_quirk_flags.xo_chip_opcodes ? MEMORY_END : CODE_END, 5) << ") {\n";
+        for (uint8_t i = 0; i <= instruction.x; i++) {
+            out << "            " << reg(i) << " = memory[I + " << hex(i, 1) << "];\n";
+        }
+        if (m_quirk_flags.load_store_increments_i) {
+            out << "            I += " << instruction.x + 1 << ";\n";
+        }
+        out << "        } else {\n"
+            << "            CALL(" << next << ", " << code << ");\n"
+            << "        }\n";
+        break;
+    case Operation::Count:
+        break;
+    }
+    write_jump(out, next_label, address + 2);
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include <Instruction.h>
+#include <Quirks.h>
+#include <Types.h>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Chip8 {
+    struct RecompilerStats {
+        size_t instructions;
+        // Bnnn jumps and the table entries guessed for them
+        size_t indirect_jumps;
+        size_t jump_table_entries;
+        // statically known targets outside of the program image
+        size_t external_targets;
+    };
+
+    /**
+     * Translates a ROM into a C++ source implementing the RecompiledAbi.h
+     * interface. Code is found by following every path from 0x200: both
+     * sides of skips, 1nnn and 2nnn targets and the instruction after
+     * each call for the 00EE coming back. Bnnn targets depend on V0, the
+     * table at nnn is followed for as long as it is made of jumps.
+     *
+     * The generated run function has one label per instruction. Static
+     * control flow becomes gotos, dynamic targets (00EE, Bnnn, skips done
+     * by the interpreter) go through a switch over every label and return
+     * to the interpreter when they land anywhere else.
+     *
+     * The instructions the quirk profiles disagree on are translated for
+     * one profile, the interpreter only loads the plugin with that one.
+     */
+    class Recompiler final {
+    public:
+        explicit Recompiler(std::vector<uint8_t> program, QuirkProfile quirks = QuirkProfile::Modern);
+        void analyse();
+        void write(std::ostream& out, const std::string& source_name) const;
+        RecompilerStats get_stats() const;
+
+        static constexpr uint16_t PROGRAM_START = 0x200;
+        // XO-CHIP programs can fill 64 KB, code only runs below 0x1000
+        static constexpr uint32_t MEMORY_END = 0x10000;
+        static constexpr uint32_t CODE_END = 0x1000;
+        static constexpr unsigned int MAX_JUMP_TABLE_ENTRIES = 128;
+
+    private:
+        bool is_instruction(uint32_t address) const;
+        uint16_t opcode_at(uint32_t address) const;
+        Instruction decode_at(uint32_t address) const;
+        void reach(uint32_t address);
+        uint32_t skip_target(uint32_t address) const;
+        void follow_jump_table(uint16_t base);
+        void write_instruction(std::ostream& out, uint16_t address, uint32_t next_label) const;
+        void write_jump(std::ostream& out, uint32_t next_label, uint32_t target) const;
+
+        std::vector<uint8_t> m_program;
+        QuirkProfile m_quirks;
+        QuirkFlags m_quirk_flags;
+        std::vector<bool> m_reachable;
+        std::vector<uint16_t> m_pending;
+        RecompilerStats m_stats {};
+    };
+}
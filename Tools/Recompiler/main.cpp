@@ -0,0 +1,89 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "Recompiler.h"
+#include <Print.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    std::string rom;
+    std::string output;
+    std::string quirks;
+    bool valid = true;
+    for (int i = 1; i < argc && valid; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--output" && has_value) {
+            output = argv[++i];
+        } else if (arg == "--quirks" && has_value) {
+            quirks = argv[++i];
+        } else if (rom.empty() && arg.rfind("--", 0) != 0) {
+            rom = arg;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid || rom.empty() || output.empty()) {
+        Common::err("Usage: ./chip8_recompile ROM --output FILE.cpp [--quirks modern|chip8|schip|xochip]\n");
+        return Common::EXIT_FAIL;
+    }
+    Chip8::QuirkProfile profile = Chip8::quirks_for_file(rom);
+    if (!quirks.empty() && !Chip8::parse_quirks(quirks, profile)) {
+        Common::err("Unknown quirk profile ", quirks);
+        return Common::EXIT_FAIL;
+    }
+
+    std::ifstream in(rom, std::ios::binary);
+    if (!in) {
+        Common::err("Failed to open ", rom);
+        return Common::EXIT_FAIL;
+    }
+    std::vector<uint8_t> program((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (program.size() > Chip8::Recompiler::MEMORY_END - Chip8::Recompiler::PROGRAM_START) {
+        Common::err(rom, " doesn't fit into memory");
+        return Common::EXIT_FAIL;
+    }
+
+    Chip8::Recompiler recompiler(std::move(program), profile);
+    recompiler.analyse();
+    auto stats = recompiler.get_stats();
+    if (stats.instructions == 0) {
+        // the generated tables would be empty arrays, which C++ doesn't allow
+        Common::err(rom, " has no reachable instructions, nothing to recompile");
+        return Common::EXIT_FAIL;
+    }
+    std::ofstream out(output);
+    recompiler.write(out, std::filesystem::path(rom).filename().string());
+    if (!out.good()) {
+        Common::err("Failed to write ", output);
+        return Common::EXIT_FAIL;
+    }
+
+    Common::msg(rom, ": ", stats.instructions, " instructions, ", stats.indirect_jumps, " indirect jumps with ",
+        stats.jump_table_entries, " table entries, ", stats.external_targets, " targets outside the program");
+    return Common::EXIT_SUCC;
+}
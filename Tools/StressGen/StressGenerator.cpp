@@ -0,0 +1,300 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "StressGenerator.h"
+#include <algorithm>
+#include <numeric>
+
+// registers VE and VF are reserved for the loop counter and the flags
+static constexpr uint16_t LOOP_COUNTER = 0xE;
+// one return address is taken by the call into the chain itself
+static constexpr unsigned int CALL_DEPTH = 12;
+static constexpr unsigned int LOOP_OVERHEAD = 8;
+
+const char* Chip8::to_string(Workload workload)
+{
+    switch (workload) {
+    case Workload::Alu:
+        return "alu";
+    case Workload::Call:
+        return "call";
+    case Workload::Sprite:
+        return "sprite";
+    case Workload::Memory:
+        return "memory";
+    case Workload::SelfModify:
+        return "smc";
+    case Workload::Random:
+        return "random";
+    case Workload::Count:
+        break;
+    }
+    return "unknown";
+}
+
+bool Chip8::parse_workload(const std::string& name, Workload& workload)
+{
+    for (size_t i = 0; i < static_cast<size_t>(Workload::Count); i++) {
+        if (name == to_string(static_cast<Workload>(i))) {
+            workload = static_cast<Workload>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+Chip8::StressGenerator::StressGenerator(StressOptions options)
+    : m_options(options)
+{
+    m_options.size = std::min(m_options.size, MAX_SIZE);
+    m_options.iterations = std::clamp(m_options.iterations, 1u, 255u);
+    m_mix_total = std::accumulate(m_options.mix.begin(), m_options.mix.end(), 0u);
+}
+
+/**
+ * Returns the ROM image, empty when the mix selects no workload at all
+ * or the result doesn't fit into memory.
+ */
+std::vector<uint8_t> Chip8::StressGenerator::generate()
+{
+    m_code.clear();
+    m_data.clear();
+    m_data_fixups.clear();
+    m_call_fixups.clear();
+    if (m_mix_total == 0) {
+        return {};
+    }
+
+    uint16_t start = here();
+    for (size_t i = 0; i < m_options.mix.size(); i++) {
+        if (m_options.mix[i] == 0) {
+            continue;
+        }
+        switch (static_cast<Workload>(i)) {
+        case Workload::Alu:
+            emit_alu();
+            break;
+        case Workload::Call:
+            emit_call();
+            break;
+        case Workload::Sprite:
+            emit_sprite();
+            break;
+        case Workload::Memory:
+            emit_memory();
+            break;
+        case Workload::SelfModify:
+            emit_self_modify();
+            break;
+        case Workload::Random:
+            emit_random();
+            break;
+        case Workload::Count:
+            break;
+        }
+    }
+    emit(0x1000u | start);
+
+    // the call chain, every level does a little work and calls the next
+    if (!m_call_fixups.empty()) {
+        for (size_t fixup : m_call_fixups) {
+            resolve(fixup, here());
+        }
+        for (unsigned int level = 0; level + 1 < CALL_DEPTH; level++) {
+            emit(0x8014);
+            emit(0x2000u | static_cast<uint16_t>(here() + 4));
+            emit(0x00EE);
+        }
+        emit(0x8014);
+        emit(0x00EE);
+    }
+
+    uint16_t data_start = here();
+    for (const auto& [fixup, offset] : m_data_fixups) {
+        resolve(fixup, data_start + offset);
+    }
+    std::vector<uint8_t> rom = m_code;
+    rom.insert(rom.end(), m_data.begin(), m_data.end());
+    if (rom.size() > MAX_SIZE) {
+        return {};
+    }
+    return rom;
+}
+
+uint16_t Chip8::StressGenerator::here() const
+{
+    return static_cast<uint16_t>(PROGRAM_START + m_code.size());
+}
+
+void Chip8::StressGenerator::emit(uint16_t opcode)
+{
+    m_code.push_back(static_cast<uint8_t>(opcode >> 8u));
+    m_code.push_back(static_cast<uint8_t>(opcode & 0xFFu));
+}
+
+size_t Chip8::StressGenerator::emit_fixup(uint16_t opcode)
+{
+    size_t position = m_code.size();
+    emit(opcode);
+    return position;
+}
+
+void Chip8::StressGenerator::resolve(size_t fixup, uint16_t address)
+{
+    m_code[fixup] = static_cast<uint8_t>((m_code[fixup] & 0xF0u) | ((address >> 8u) & 0x0Fu));
+    m_code[fixup + 1] = static_cast<uint8_t>(address & 0xFFu);
+}
+
+void Chip8::StressGenerator::begin_loop(uint16_t& loop_start)
+{
+    emit(0x6000u | (LOOP_COUNTER << 8u) | m_options.iterations);
+    loop_start = here();
+}
+
+/**
+ * Decrements the counter and jumps back until it reaches zero.
+ */
+void Chip8::StressGenerator::end_loop(uint16_t loop_start)
+{
+    emit(0x7000u | (LOOP_COUNTER << 8u) | 0xFFu);
+    emit(0x3000u | (LOOP_COUNTER << 8u));
+    emit(0x1000u | loop_start);
+}
+
+unsigned int Chip8::StressGenerator::unroll_for(Workload workload, unsigned int body_size) const
+{
+    unsigned int share = m_options.size * m_options.mix[static_cast<size_t>(workload)] / m_mix_total;
+    return std::max(1u, (share > LOOP_OVERHEAD ? share - LOOP_OVERHEAD : 0) / body_size);
+}
+
+void Chip8::StressGenerator::emit_alu()
+{
+    for (uint16_t reg = 0; reg < 8; reg++) {
+        emit(0x6000u | (reg << 8u) | (reg * 37u + 1u));
+    }
+    uint16_t loop;
+    begin_loop(loop);
+    for (unsigned int i = unroll_for(Workload::Alu, 18); i > 0; i--) {
+        emit(0x8014);
+        emit(0x8125);
+        emit(0x8231);
+        emit(0x8342);
+        emit(0x8453);
+        emit(0x8566);
+        emit(0x8677);
+        emit(0x878E);
+        emit(0x7011);
+    }
+    end_loop(loop);
+}
+
+void Chip8::StressGenerator::emit_call()
+{
+    uint16_t loop;
+    begin_loop(loop);
+    for (unsigned int i = unroll_for(Workload::Call, 2); i > 0; i--) {
+        m_call_fixups.push_back(emit_fixup(0x2000));
+    }
+    end_loop(loop);
+}
+
+/**
+ * Draws a solid 15 row sprite twice per position while moving diagonally
+ * across the screen and past its edges, so most draws collide.
+ */
+void Chip8::StressGenerator::emit_sprite()
+{
+    static const uint8_t SPRITE[] = { 0xFF, 0xAA, 0xFF, 0x55, 0xFF, 0xAA, 0xFF, 0x55, 0xFF, 0xAA, 0xFF, 0x55, 0xFF, 0xAA, 0xFF };
+    m_data_fixups.emplace_back(emit_fixup(0xA000), static_cast<uint16_t>(m_data.size()));
+    m_data.insert(m_data.end(), std::begin(SPRITE), std::end(SPRITE));
+    m_data.resize(m_data.size() + m_data.size() % 2);
+    emit(0x6100);
+    emit(0x6200);
+    uint16_t loop;
+    begin_loop(loop);
+    for (unsigned int i = unroll_for(Workload::Sprite, 8); i > 0; i--) {
+        emit(0xD12F);
+        emit(0x7105);
+        emit(0xD12F);
+        emit(0x7203);
+    }
+    end_loop(loop);
+}
+
+/**
+ * Stores and reloads V0-VB while I sweeps through a buffer, every pass
+ * starts over at the beginning of the buffer.
+ */
+void Chip8::StressGenerator::emit_memory()
+{
+    // six bytes of code and twelve bytes of buffer per unrolled step
+    unsigned int steps = unroll_for(Workload::Memory, 18);
+    emit(0x6C0C);
+    uint16_t loop;
+    begin_loop(loop);
+    m_data_fixups.emplace_back(emit_fixup(0xA000), static_cast<uint16_t>(m_data.size()));
+    for (unsigned int i = steps; i > 0; i--) {
+        emit(0xFB55);
+        emit(0xFB65);
+        emit(0xFC1E);
+    }
+    end_loop(loop);
+    m_data.resize(m_data.size() + 12 * (steps + 1));
+}
+
+/**
+ * Every step overwrites the instruction right after it with 7301 or 7302,
+ * alternating, so the decoded instruction is stale on every execution.
+ */
+void Chip8::StressGenerator::emit_self_modify()
+{
+    emit(0x6073);
+    emit(0x6101);
+    emit(0x6203);
+    uint16_t loop;
+    begin_loop(loop);
+    for (unsigned int i = unroll_for(Workload::SelfModify, 8); i > 0; i--) {
+        emit(0xA000u | static_cast<uint16_t>(here() + 4));
+        emit(0xF155);
+        emit(0x7301);
+        emit(0x8123);
+    }
+    end_loop(loop);
+}
+
+void Chip8::StressGenerator::emit_random()
+{
+    uint16_t loop;
+    begin_loop(loop);
+    for (unsigned int i = unroll_for(Workload::Random, 16); i > 0; i--) {
+        emit(0xC0FF);
+        emit(0xC10F);
+        emit(0x8012);
+        emit(0x3000);
+        emit(0x7201);
+        emit(0xC37F);
+        emit(0x4300);
+        emit(0x7401);
+    }
+    end_loop(loop);
+}
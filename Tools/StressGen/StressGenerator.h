@@ -0,0 +1,102 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include <Types.h>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Chip8 {
+    /**
+     * Each workload hammers one part of the interpreter:
+     *
+     *   Alu      8xyN arithmetic and 7xkk, Cpu dispatch only
+     *   Call     2nnn/00EE chains close to the maximum stack depth
+     *   Sprite   overlapping 15 row Dxyn draws, every draw collides
+     *   Memory   Fx55/Fx65 register dumps and loads sweeping a buffer
+     *   SelfModify  Fx55 rewriting the next instruction, decode cache
+     *               invalidation on every pass
+     *   Random   Cxkk feeding skips
+     */
+    enum class Workload {
+        Alu,
+        Call,
+        Sprite,
+        Memory,
+        SelfModify,
+        Random,
+        Count
+    };
+
+    const char* to_string(Workload workload);
+    bool parse_workload(const std::string& name, Workload& workload);
+
+    struct StressOptions {
+        // relative share of the code size per workload, 0 leaves it out
+        std::array<unsigned int, static_cast<size_t>(Workload::Count)> mix { 1, 1, 1, 1, 1, 1 };
+        // approximate size of the generated program in bytes
+        unsigned int size = 2048;
+        // passes through each workload loop before moving on to the next
+        unsigned int iterations = 64;
+    };
+
+    /**
+     * Generates a ROM that runs every workload of the mix in turn, forever.
+     * Each workload is a counted loop whose body is unrolled until the
+     * workload has its share of the requested size.
+     */
+    class StressGenerator final {
+    public:
+        explicit StressGenerator(StressOptions options);
+        std::vector<uint8_t> generate();
+
+        static constexpr uint16_t PROGRAM_START = 0x200;
+        static constexpr unsigned int MAX_SIZE = 0x1000 - PROGRAM_START;
+
+    private:
+        uint16_t here() const;
+        void emit(uint16_t opcode);
+        size_t emit_fixup(uint16_t opcode);
+        void resolve(size_t fixup, uint16_t address);
+        void begin_loop(uint16_t& loop_start);
+        void end_loop(uint16_t loop_start);
+        unsigned int unroll_for(Workload workload, unsigned int body_size) const;
+
+        void emit_alu();
+        void emit_call();
+        void emit_sprite();
+        void emit_memory();
+        void emit_self_modify();
+        void emit_random();
+
+        StressOptions m_options;
+        unsigned int m_mix_total = 0;
+        std::vector<uint8_t> m_code;
+        std::vector<uint8_t> m_data;
+        // code positions of instructions whose nnn points into m_data
+        std::vector<std::pair<size_t, uint16_t>> m_data_fixups;
+        std::vector<size_t> m_call_fixups;
+    };
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2021, Patrick Wilmes <patrick.wilmes@bit-lake.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+#include "StressGenerator.h"
+#include <Print.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+static bool write_rom(const std::string& file, const std::vector<uint8_t>& rom)
+{
+    std::ofstream out(file, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(rom.data()), rom.size());
+    return out.good();
+}
+
+/**
+ * Parses "alu=3,call=1,...", workloads not mentioned are left out.
+ */
+static bool parse_mix(const std::string& value, Chip8::StressOptions& options)
+{
+    options.mix.fill(0);
+    std::istringstream entries(value);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        auto separator = entry.find('=');
+        Chip8::Workload workload;
+        if (!Chip8::parse_workload(entry.substr(0, separator), workload)) {
+            return false;
+        }
+        options.mix[static_cast<size_t>(workload)] = separator == std::string::npos ? 1 : std::stoul(entry.substr(separator + 1));
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Chip8::StressOptions options;
+    std::string output;
+    std::string suite;
+    bool valid = true;
+    try {
+        for (int i = 1; i < argc && valid; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--mix" && has_value) {
+                valid = parse_mix(argv[++i], options);
+            } else if (arg == "--size" && has_value) {
+                options.size = std::stoul(argv[++i]);
+            } else if (arg == "--iterations" && has_value) {
+                options.iterations = std::stoul(argv[++i]);
+            } else if (arg == "--output" && has_value) {
+                output = argv[++i];
+            } else if (arg == "--suite" && has_value) {
+                suite = argv[++i];
+            } else {
+                valid = false;
+            }
+        }
+    } catch (const std::logic_error&) {
+        // not a number
+        valid = false;
+    }
+    if (!valid || output.empty() == suite.empty()) {
+        Common::err("Usage: ./chip8_stressgen [--mix alu=N,call=N,sprite=N,memory=N,smc=N,random=N] [--size BYTES] [--iterations N] --output FILE | --suite DIRECTORY\n");
+        return Common::EXIT_FAIL;
+    }
+
+    if (!output.empty()) {
+        auto rom = Chip8::StressGenerator(options).generate();
+        if (rom.empty() || !write_rom(output, rom)) {
+            Common::err("Failed to generate ", output);
+            return Common::EXIT_FAIL;
+        }
+        return Common::EXIT_SUCC;
+    }
+
+    // one ROM per workload plus one with the requested mix
+    std::filesystem::create_directories(suite);
+    for (size_t i = 0; i <= options.mix.size(); i++) {
+        Chip8::StressOptions suite_options = options;
+        std::string name = "mix";
+        if (i < options.mix.size()) {
+            suite_options.mix.fill(0);
+            suite_options.mix[i] = 1;
+            name = Chip8::to_string(static_cast<Chip8::Workload>(i));
+        }
+        auto file = (std::filesystem::path(suite) / ("stress_" + name + ".ch8")).string();
+        auto rom = Chip8::StressGenerator(suite_options).generate();
+        if (rom.empty() || !write_rom(file, rom)) {
+            Common::err("Failed to generate ", file);
+            return Common::EXIT_FAIL;
+        }
+        Common::msg(file, ": ", rom.size(), " bytes");
+    }
+    return Common::EXIT_SUCC;
+}